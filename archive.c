@@ -0,0 +1,331 @@
+#include "archive.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define ARCHIVE_MAGIC           "TZAR"
+#define HEADER_SIZE             32
+#define INDEX_ENTRY_SIZE        16
+#define OPTIONS_SIZE            8
+#define SCORE_SIZE              (5 * 4)
+
+/*
+ * header:      magic, version (4), index offset (8), blocks (4),
+ *              reserved (4), records (8)
+ * index entry: block offset (8), record count (4), reserved (4)
+ */
+
+static void put_le32(uint8_t *p, uint32_t value)
+{
+    int i;
+
+    for (i = 0; i < 4; i++)
+        p[i] = (uint8_t)(value >> (8 * i));
+}
+
+static void put_le64(uint8_t *p, uint64_t value)
+{
+    int i;
+
+    for (i = 0; i < 8; i++)
+        p[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+        (uint32_t)p[3] << 24;
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+    return (uint64_t)get_le32(p) | (uint64_t)get_le32(p + 4) << 32;
+}
+
+static uint64_t align8(uint64_t value)
+{
+    return (value + 7) & ~(uint64_t)7;
+}
+
+/* where each column of a block of count records starts, from the block */
+static void column_offsets(uint64_t count, uint64_t *options,
+        uint64_t *scores, uint64_t *offsets, uint64_t *events)
+{
+    *options = 8 * count;
+    *scores = *options + OPTIONS_SIZE * count;
+    *offsets = align8(*scores + SCORE_SIZE * count);
+    *events = *offsets + 8 * (count + 1);
+}
+
+
+int archive_open(struct archive *archive, const char *path)
+{
+    int fd;
+    struct stat st;
+    uint64_t index;
+    void *map;
+
+    memset(archive, 0, sizeof (*archive));
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return FAILURE;
+
+    if (fstat(fd, &st) || st.st_size < HEADER_SIZE) {
+        close(fd);
+        return FAILURE;
+    }
+
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return FAILURE;
+
+    /* we stream through the whole file, front to back */
+    madvise(map, st.st_size, MADV_SEQUENTIAL);
+
+    archive->map = map;
+    archive->size = st.st_size;
+
+    if (memcmp(archive->map, ARCHIVE_MAGIC, 4) ||
+            get_le32(archive->map + 4) != ARCHIVE_VERSION)
+        goto corrupt;
+
+    index = get_le64(archive->map + 8);
+    archive->blocks = get_le32(archive->map + 16);
+    archive->records = get_le64(archive->map + 24);
+
+    if (archive->blocks && (index < HEADER_SIZE || index > archive->size ||
+                (archive->size - index) / INDEX_ENTRY_SIZE < archive->blocks))
+        goto corrupt;
+    archive->index = archive->map + index;
+
+    return SUCCESS;
+
+corrupt:
+    archive_close(archive);
+    return FAILURE;
+}
+
+void archive_close(struct archive *archive)
+{
+    if (archive->map)
+        munmap((void *)archive->map, archive->size);
+    memset(archive, 0, sizeof (*archive));
+}
+
+int archive_block(const struct archive *archive, uint32_t index,
+        struct archive_block *block)
+{
+    const uint8_t *entry;
+    uint64_t offset, count, options, scores, offsets, events;
+
+    if (index >= archive->blocks)
+        return FAILURE;
+
+    entry = archive->index + (size_t)index * INDEX_ENTRY_SIZE;
+    offset = get_le64(entry);
+    count = get_le32(entry + 8);
+    column_offsets(count, &options, &scores, &offsets, &events);
+
+    if (offset < HEADER_SIZE || offset > archive->size ||
+            events > archive->size - offset)
+        return FAILURE;
+
+    block->count = (uint32_t)count;
+    block->seeds = archive->map + offset;
+    block->options = block->seeds + options;
+    block->scores = block->seeds + scores;
+    block->offsets = block->seeds + offsets;
+    block->events = block->seeds + events;
+    block->events_length = get_le64(block->offsets + 8 * count);
+
+    if (block->events_length > archive->size - offset - events)
+        return FAILURE;
+
+    return SUCCESS;
+}
+
+int archive_record(const struct archive_block *block, uint32_t index,
+        struct archive_record *record)
+{
+    const uint8_t *options, *scores;
+    uint64_t start, end;
+
+    if (index >= block->count)
+        return FAILURE;
+
+    start = get_le64(block->offsets + 8 * (size_t)index);
+    end = get_le64(block->offsets + 8 * ((size_t)index + 1));
+    if (start > end || end > block->events_length)
+        return FAILURE;
+
+    record->seed = get_le64(block->seeds + 8 * (size_t)index);
+
+    options = block->options + OPTIONS_SIZE * (size_t)index;
+    record->options.increase_difficulty = options[0];
+    record->options.display_colors = options[1];
+    record->options.initial_level = options[2];
+    record->options.clear_on_new_level = options[3];
+    record->options.randomizer = (randomizer_t)options[4];
+    if (replay_check_options(&record->options) == FAILURE)
+        return FAILURE;
+
+    scores = block->scores + SCORE_SIZE * (size_t)index;
+    record->final_score.level = (int)get_le32(scores);
+    record->final_score.rows_cleared = (int)get_le32(scores + 4);
+    record->final_score.total_rows = (int)get_le32(scores + 8);
+    record->final_score.score = (int)get_le32(scores + 12);
+    record->final_score.current_highscore = (int)get_le32(scores + 16);
+
+    record->events = block->events + start;
+    record->length = end - start;
+
+    return SUCCESS;
+}
+
+
+static int write_all(int fd, const void *buffer, size_t length, off_t offset)
+{
+    const uint8_t *p = buffer;
+
+    while (length) {
+        ssize_t written = pwrite(fd, p, length, offset);
+
+        if (written <= 0)
+            return FAILURE;
+        p += written;
+        offset += written;
+        length -= written;
+    }
+
+    return SUCCESS;
+}
+
+/* lay out a block of count replays in memory, as it goes on disk */
+static uint8_t *build_block(const struct replay *replays, uint32_t count,
+        size_t *size)
+{
+    uint32_t i;
+    uint8_t *block, *p;
+    uint64_t options, scores, offsets, events, length = 0;
+
+    column_offsets(count, &options, &scores, &offsets, &events);
+    for (i = 0; i < count; i++)
+        length += replays[i].length;
+
+    *size = align8(events + length);
+    block = calloc(1, *size);
+    if (!block)
+        return NULL;
+
+    length = 0;
+    for (i = 0; i < count; i++) {
+        const struct replay *replay = &replays[i];
+        const struct game_score *score = &replay->final_score;
+
+        put_le64(block + 8 * i, replay->seed);
+
+        p = block + options + OPTIONS_SIZE * i;
+        p[0] = (uint8_t)replay->options.increase_difficulty;
+        p[1] = (uint8_t)replay->options.display_colors;
+        p[2] = (uint8_t)replay->options.initial_level;
+        p[3] = (uint8_t)replay->options.clear_on_new_level;
+        p[4] = (uint8_t)replay->options.randomizer;
+
+        p = block + scores + SCORE_SIZE * i;
+        put_le32(p, (uint32_t)score->level);
+        put_le32(p + 4, (uint32_t)score->rows_cleared);
+        put_le32(p + 8, (uint32_t)score->total_rows);
+        put_le32(p + 12, (uint32_t)score->score);
+        put_le32(p + 16, (uint32_t)score->current_highscore);
+
+        put_le64(block + offsets + 8 * i, length);
+        if (replay->length)
+            memcpy(block + events + length, replay->events, replay->length);
+        length += replay->length;
+    }
+    put_le64(block + offsets + 8 * (uint64_t)count, length);
+
+    return block;
+}
+
+/* add the replays to the archive at path as one new block */
+int archive_append(const char *path, const struct replay *replays,
+        uint32_t count)
+{
+    int fd;
+    struct stat st;
+    uint8_t header[HEADER_SIZE];
+    uint8_t *block = NULL, *index = NULL;
+    size_t block_size, index_size;
+    uint64_t end, old_index = 0, records = 0;
+    uint32_t blocks = 0;
+    int status = FAILURE;
+
+    fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd < 0)
+        return FAILURE;
+
+    if (fstat(fd, &st))
+        goto out;
+
+    if (st.st_size) {
+        if (pread(fd, header, HEADER_SIZE, 0) != HEADER_SIZE ||
+                memcmp(header, ARCHIVE_MAGIC, 4) ||
+                get_le32(header + 4) != ARCHIVE_VERSION)
+            goto out;
+
+        old_index = get_le64(header + 8);
+        blocks = get_le32(header + 16);
+        records = get_le64(header + 24);
+    }
+
+    /* the old index entries, followed by the one for the new block */
+    index_size = ((size_t)blocks + 1) * INDEX_ENTRY_SIZE;
+    index = malloc(index_size);
+    if (!index)
+        goto out;
+    if (blocks && pread(fd, index, index_size - INDEX_ENTRY_SIZE, old_index) !=
+            (ssize_t)(index_size - INDEX_ENTRY_SIZE))
+        goto out;
+
+    block = build_block(replays, count, &block_size);
+    if (!block)
+        goto out;
+
+    end = align8(st.st_size > HEADER_SIZE ? st.st_size : HEADER_SIZE);
+    put_le64(index + (size_t)blocks * INDEX_ENTRY_SIZE, end);
+    put_le32(index + (size_t)blocks * INDEX_ENTRY_SIZE + 8, count);
+    put_le32(index + (size_t)blocks * INDEX_ENTRY_SIZE + 12, 0);
+
+    /* the data first, and once that is safely on disk, the header */
+    if (write_all(fd, block, block_size, end) ||
+            write_all(fd, index, index_size, end + block_size) || fsync(fd))
+        goto out;
+
+    memcpy(header, ARCHIVE_MAGIC, 4);
+    put_le32(header + 4, ARCHIVE_VERSION);
+    put_le64(header + 8, end + block_size);
+    put_le32(header + 16, blocks + 1);
+    put_le32(header + 20, 0);
+    put_le64(header + 24, records + count);
+
+    if (write_all(fd, header, HEADER_SIZE, 0) || fsync(fd))
+        goto out;
+
+    status = SUCCESS;
+
+out:
+    free(block);
+    free(index);
+    if (close(fd))
+        status = FAILURE;
+    return status;
+}
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
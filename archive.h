@@ -0,0 +1,69 @@
+#ifndef __ARCHIVE_H__
+#define __ARCHIVE_H__
+
+#include "replay.h"
+
+#include <stddef.h>
+
+/*
+ * Replay archives: many replays in one file, laid out for bulk reading. The
+ * file is a header, any number of blocks, and an index of the blocks at the
+ * end. Every block stores its records column by column:
+ *
+ *     seeds           count * 8 bytes
+ *     options         count * 8 bytes (5 used, the rest padding)
+ *     final scores    count * 5 * 4 bytes
+ *     event offsets   (count + 1) * 8 bytes, into the event blob
+ *     event blob      the concatenated replay event streams
+ *
+ * with every column starting at an 8 byte boundary, and all integers little
+ * endian. Appending writes a new block and a new index past the end of the
+ * file and only then points the header at the new index, so an interrupted
+ * append leaves the archive as it was.
+ *
+ * Readers map the file and hand out pointers straight into the mapping, so
+ * nothing is copied on the way to the engine.
+ */
+
+#define ARCHIVE_VERSION         1
+
+struct archive {
+    const uint8_t *map;
+    size_t size;
+    const uint8_t *index;       /* the block index, inside the mapping */
+    uint32_t blocks;
+    uint64_t records;
+};
+
+struct archive_block {
+    uint32_t count;
+    const uint8_t *seeds;
+    const uint8_t *options;
+    const uint8_t *scores;
+    const uint8_t *offsets;
+    const uint8_t *events;
+    uint64_t events_length;
+};
+
+/* one replay of an archive; events points into the mapping */
+struct archive_record {
+    uint64_t seed;
+    struct game_options options;
+    struct game_score final_score;
+    const uint8_t *events;
+    size_t length;
+};
+
+int archive_open(struct archive *archive, const char *path);
+void archive_close(struct archive *archive);
+int archive_block(const struct archive *archive, uint32_t index,
+        struct archive_block *block);
+int archive_record(const struct archive_block *block, uint32_t index,
+        struct archive_record *record);
+
+int archive_append(const char *path, const struct replay *replays,
+        uint32_t count);
+
+#endif	/* __ARCHIVE_H__ */
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
@@ -0,0 +1,164 @@
+#include "bot.h"
+
+#include <time.h>
+
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+/* a beam keeping the best width boards per depth, 1 to BEAM_WIDTH_MAX */
+void beam_init(struct beam *beam, int width)
+{
+    if (width < 1)
+        width = 1;
+    if (width > BEAM_WIDTH_MAX)
+        width = BEAM_WIDTH_MAX;
+
+    beam->width = width;
+    beam->depth = 0;
+}
+
+/*
+ * The time to choose in (in ns): a share of the gravity interval, so that
+ * the answer is in before the block has fallen a row.
+ */
+long beam_budget(const struct game_state *game)
+{
+    return game->timeout * 1000000L / BEAM_BUDGET_SHARE;
+}
+
+/*
+ * Keep the candidate if it's among the best width of the count kept so far,
+ * in order; returns how many are kept now.
+ */
+static int keep(struct beam *beam, int count, double score, int parent,
+        int root, const struct block *block)
+{
+    int i;
+    struct beam_candidate *kept = beam->kept;
+
+    if (count == beam->width) {
+        if (score <= kept[count - 1].score)
+            return count;
+        count--;                        /* the worst one makes way */
+    }
+
+    for (i = count; i > 0 && kept[i - 1].score < score; i--)
+        kept[i] = kept[i - 1];
+
+    kept[i].score = score;
+    kept[i].parent = parent;
+    kept[i].root = root;
+    kept[i].block = *block;
+    return count + 1;
+}
+
+/*
+ * Lock the kept blocks into their boards, and deal the next block onto
+ * each of them, into layer; returns how many boards are left, best first.
+ */
+static int lock_kept(struct beam *beam, int count,
+        const struct game_state *game,
+        const struct beam_node *parents, struct beam_node *layer,
+        const struct bot_weights *weights)
+{
+    int i, j;
+    int total = 0;
+    const struct beam_candidate *candidate;
+    struct beam_node *node;
+
+    for (i = 0; i < count; i++) {
+        candidate = &beam->kept[i];
+        node = &layer[total];
+
+        if (parents) {
+            node->game = parents[candidate->parent].game;
+            node->base = parents[candidate->parent].base;
+        } else {
+            node->game = *game;
+            node->base = 0;
+        }
+
+        /* it's resting already, so a tick locks it, and the next spawns */
+        node->game.current = candidate->block;
+        game_gravity_tick(&node->game, NULL);
+        if (game_gravity_tick(&node->game, NULL) & GAME_EVENT_GAME_OVER)
+            continue;
+
+        for (j = 0; j < total; j++) {
+            if (layer[j].game.hash == node->game.hash)
+                break;
+        }
+        if (j < total)
+            continue;                   /* the same board, and worse */
+
+        node->base += weights->lines * node->game.cleared_count;
+        node->root = candidate->root;
+        total++;
+    }
+
+    return total;
+}
+
+/*
+ * The placement of the current block the beam search finds best, as above,
+ * looking for no longer than budget ns; FAILURE if there's none at all.
+ */
+int beam_choose(struct beam *beam, const struct game_state *game,
+        const struct bot_weights *weights, long budget,
+        struct placement *placement)
+{
+    int i, j, depth, roots, nodes, count;
+    int kept = 0;
+    int best;
+    uint64_t deadline = now_ns() + budget;
+    struct beam_node *layer = NULL;
+    const struct game_state *parent;
+
+    roots = game_reachable_placements(game, beam->roots, PLACEMENTS_MAX);
+    if (!roots)
+        return FAILURE;
+
+    for (i = 0; i < roots; i++)
+        kept = keep(beam, kept, bot_evaluate(game, &beam->roots[i].block,
+                    weights), -1, i, &beam->roots[i].block);
+    best = beam->kept[0].root;
+    beam->depth = 1;
+
+    for (depth = 1; depth < BEAM_DEPTH; depth++) {
+        nodes = lock_kept(beam, kept, game, layer, beam->nodes[depth & 1],
+                weights);
+        layer = beam->nodes[depth & 1];
+
+        /* the best boards first, for as long as there's time */
+        kept = 0;
+        for (i = 0; i < nodes && (i == 0 || now_ns() < deadline); i++) {
+            parent = &layer[i].game;
+            count = game_reachable_placements(parent, beam->placements,
+                    PLACEMENTS_MAX);
+
+            for (j = 0; j < count; j++)
+                kept = keep(beam, kept, layer[i].base +
+                        bot_evaluate(parent, &beam->placements[j].block,
+                            weights), i, layer[i].root,
+                        &beam->placements[j].block);
+        }
+
+        if (!kept)
+            break;                      /* it's game over whatever we do */
+
+        best = beam->kept[0].root;
+        beam->depth = depth + 1;
+        if (i < nodes)
+            break;                      /* out of time */
+    }
+
+    *placement = beam->roots[best];
+    return SUCCESS;
+}
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
@@ -0,0 +1,113 @@
+#include "bot.h"
+
+#include <string.h>
+
+/* as tuned for this set of features by a genetic search, in the literature */
+const struct bot_weights bot_default_weights = {
+    -0.510066,                          /* height */
+    0.760666,                           /* lines */
+    -0.35663,                           /* holes */
+    -0.184483,                          /* bumpiness */
+};
+
+/*
+ * The board with the block locked in where it is, and the full rows taken
+ * out, in rows (GAME_BOARD_HEIGHT + 2 of them, as game_state.board); returns
+ * the number of rows cleared.
+ */
+static int lock_block(const struct game_state *game, const struct block *block,
+        row_t *rows)
+{
+    int i, src, dst;
+    int cleared = 0;
+    const struct piece_shape *shape =
+        &piece_shapes[block->type][block->orientation];
+    int shift = block->origin.x + shape->x0 + 1;
+    int row = block->origin.y + 1;
+
+    memcpy(rows, game->board, sizeof (game->board));
+    for (i = shape->y0; i <= shape->y1; i++)
+        rows[row + i] |= (row_t)(shape->rows[i] << shift);
+
+    /* only the rows of the block can have filled up, nothing below moves */
+    for (src = dst = row + shape->y1; src >= 1; src--) {
+        if (rows[src] == BOARD_FULL_ROW)
+            cleared++;
+        else
+            rows[dst--] = rows[src];
+    }
+    for (; dst >= 1; dst--)
+        rows[dst] = BOARD_WALLS;
+
+    return cleared;
+}
+
+void bot_features(const struct game_state *game, const struct block *block,
+        struct bot_features *features)
+{
+    int x, y;
+    row_t rows[GAME_BOARD_HEIGHT + 2];
+    row_t cells, covered = 0;
+    unsigned int tops;
+    int heights[GAME_BOARD_WIDTH] = { 0 };
+
+    memset(features, 0, sizeof (*features));
+    features->lines = lock_block(game, block, rows);
+
+    /* top down: a column's height is where it's first covered */
+    for (y = 1 + features->lines; y <= GAME_BOARD_HEIGHT; y++) {
+        cells = rows[y] & ~BOARD_WALLS;
+        features->holes += __builtin_popcount(covered & ~cells);
+
+        for (tops = cells & ~covered; tops; tops &= tops - 1) {
+            x = __builtin_ctz(tops) - 1;
+            heights[x] = GAME_BOARD_HEIGHT + 1 - y;
+            features->height += heights[x];
+        }
+        covered |= cells;
+    }
+
+    for (x = 1; x < GAME_BOARD_WIDTH; x++)
+        features->bumpiness += heights[x] > heights[x - 1] ?
+            heights[x] - heights[x - 1] : heights[x - 1] - heights[x];
+}
+
+/* the score of the board the block leaves behind, the higher the better */
+double bot_evaluate(const struct game_state *game, const struct block *block,
+        const struct bot_weights *weights)
+{
+    struct bot_features features;
+
+    bot_features(game, block, &features);
+    return weights->height * features.height +
+        weights->lines * features.lines +
+        weights->holes * features.holes +
+        weights->bumpiness * features.bumpiness;
+}
+
+/* the best placement of the current block, FAILURE if there's none at all */
+int bot_choose(const struct game_state *game,
+        const struct bot_weights *weights, struct placement *placement)
+{
+    int i, count;
+    int best = 0;
+    double score, best_score = 0;
+    struct placement placements[PLACEMENTS_MAX];
+
+    count = game_reachable_placements(game, placements, PLACEMENTS_MAX);
+    if (!count)
+        return FAILURE;
+
+    for (i = 0; i < count; i++) {
+        score = bot_evaluate(game, &placements[i].block, weights);
+        if (i == 0 || score > best_score) {
+            best = i;
+            best_score = score;
+        }
+    }
+
+    *placement = placements[best];
+    return SUCCESS;
+}
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
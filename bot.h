@@ -0,0 +1,98 @@
+#ifndef __BOT_H__
+#define __BOT_H__
+
+#include "engine.h"
+
+/*
+ * A bot that plays the engine: it looks at every placement the current
+ * block can reach (see game_reachable_placements()), and takes the one that
+ * leaves the best board behind, as scored by a weighted sum of
+ *
+ *   - the aggregate height, the heights of all the columns added up,
+ *   - the lines the block clears,
+ *   - the holes, empty cells with a filled one somewhere above them,
+ *   - the bumpiness, how much neighbouring columns differ in height.
+ *
+ * Scoring a board is a single pass over its rows, so a whole set of
+ * placements takes a few microseconds.
+ */
+
+struct bot_weights {
+    double height;
+    double lines;
+    double holes;
+    double bumpiness;
+};
+
+/* the board features a placement is scored on */
+struct bot_features {
+    int height;
+    int lines;
+    int holes;
+    int bumpiness;
+};
+
+extern const struct bot_weights bot_default_weights;
+
+void bot_features(const struct game_state *game, const struct block *block,
+        struct bot_features *features);
+double bot_evaluate(const struct game_state *game, const struct block *block,
+        const struct bot_weights *weights);
+int bot_choose(const struct game_state *game,
+        const struct bot_weights *weights, struct placement *placement);
+
+/*
+ * A bot that looks ahead to the next block too, the one the preview shows:
+ * a beam search that scores the places of the current block as above, keeps
+ * the best width of the boards they leave, and then places the next block
+ * on each of those in turn, the most promising first. The place of the
+ * current block that leads to the best board of all is the one it takes.
+ * Boards that come out the same (by their hash) are only kept once, and a
+ * board a block can't be dealt onto any more isn't kept at all.
+ *
+ * It answers by the deadline it's given, give or take one board's worth of
+ * placements, a few microseconds: the boards of the next block are looked
+ * at for as long as there's time, and when there's none left, the best one
+ * found so far wins (or, if none was, the best board of the current block).
+ *
+ * All of its boards live in the struct beam, which is set up once and then
+ * reused for every block, so that choosing takes nothing off the heap.
+ */
+
+#define BEAM_DEPTH          2           /* the current and the next block */
+#define BEAM_WIDTH_MAX      64
+#define BEAM_DEFAULT_WIDTH  16
+#define BEAM_BUDGET_SHARE   2           /* of a gravity interval, see below */
+
+struct beam_node {
+    struct game_state game;             /* with the block locked in */
+    double base;                        /* for the lines cleared to get here */
+    int root;                           /* in beam.roots */
+};
+
+/* a place for a block, and how good a board it leaves behind */
+struct beam_candidate {
+    double score;
+    int parent;                         /* in the last layer of nodes */
+    int root;
+    struct block block;
+};
+
+struct beam {
+    int width;                          /* the boards kept per depth */
+    int depth;                          /* how deep the last choice went */
+    struct beam_node nodes[2][BEAM_WIDTH_MAX];
+    struct beam_candidate kept[BEAM_WIDTH_MAX];     /* best first */
+    struct placement roots[PLACEMENTS_MAX];
+    struct placement placements[PLACEMENTS_MAX];
+};
+
+void beam_init(struct beam *beam, int width);
+long beam_budget(const struct game_state *game);
+int beam_choose(struct beam *beam, const struct game_state *game,
+        const struct bot_weights *weights, long budget,
+        struct placement *placement);
+
+#endif	/* __BOT_H__ */
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
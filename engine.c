@@ -0,0 +1,547 @@
+#include "engine.h"
+
+#include <assert.h>
+#include <string.h>
+
+#define BASE_SCORE_PER_ROW  10		/* score awarded for each row cleared */
+#define MAX_ROWS_PER_LEVEL	20		/* rows to clear before next level */
+
+/* formula for calculating timeout reduction delta with each new level */
+#define TIMEOUT_DELTA(level)    ((DIFFICULTY_LEVEL_MAX - (level) + 1) * 3)
+
+typedef enum {
+    ACTION_MOVE_UP_DROP,            /* drop the block at the floor */
+    ACTION_MOVE_LEFT,
+    ACTION_MOVE_RIGHT,
+    ACTION_MOVE_DOWN,
+    ACTION_ROTATE_LEFT,
+    ACTION_ROTATE_RIGHT,
+    ACTION_PLACE_NEW,
+
+    TOTAL_MOVEMENTS
+} action_t;
+
+static int move_block(const struct game_state *game, struct block *block,
+        action_t movement);
+static void update_current_block(struct game_state *game);
+static void freeze_block(struct game_state *game, struct block *current);
+static int clear_even_rows(struct game_state *game, int *cleared_rows);
+static int test_movement(const struct game_state *game, struct block *block);
+static int update_score_level(struct game_state *game, int num_rows);
+static void reset_game_board(struct game_state *game);
+
+static const struct point starting_position = { 4, 0 };
+
+#ifdef TETRIZ_STATS
+_Static_assert(TOTAL_MOVEMENTS == ENGINE_ACTIONS, "an action has no counter");
+
+_Thread_local struct engine_stats engine_stats;
+
+const char *const engine_action_names[ENGINE_ACTIONS] = {
+    "drop", "left", "right", "down", "rotate_left", "rotate_right",
+    "place_new",
+};
+
+#define COUNT(counter)      (engine_stats.counter++)
+#else
+#define COUNT(counter)      ((void)0)
+#endif
+
+#ifndef NDEBUG
+/* the hash worked out from scratch, to check the one kept up to date */
+static uint64_t full_hash(const struct game_state *game)
+{
+    int i;
+    uint64_t hash = zobrist_next[game->next_block];
+
+    for (i = 1; i < GAME_BOARD_HEIGHT + 1; i++)
+        hash ^= zobrist_row(i, game->board[i]);
+    if (game->has_current)
+        hash ^= zobrist_current[game->current.type];
+
+    return hash;
+}
+#endif
+
+static void reset_game_board(struct game_state *game)
+{
+    int i;
+
+    /* take the cells out of the hash before they go */
+    for (i = game->top_row > 1 ? game->top_row : 1;
+            i < GAME_BOARD_HEIGHT + 1; i++)
+        game->hash ^= zobrist_row(i, game->board[i]);
+
+    game->board[0] = game->board[GAME_BOARD_HEIGHT + 1] = BOARD_FULL_ROW;
+    for (i = 1; i < GAME_BOARD_HEIGHT + 1; i++)
+        game->board[i] = BOARD_WALLS;
+
+    memset(game->col_heights, 0, sizeof (game->col_heights));
+    memset(game->row_fill, 0, sizeof (game->row_fill));
+
+    game->top_row = GAME_BOARD_HEIGHT + 1;      /* i.e. the floor */
+    game->full_rows = 0;
+}
+
+
+void game_init(struct game_state *game, const struct game_options *options,
+        int highscore, uint64_t seed)
+{
+    int i;
+
+    memset(game, 0, sizeof (*game));
+    game->options = *options;
+    randomizer_init(&game->randomizer, options->randomizer, seed);
+
+    /* initialize the board */
+    reset_game_board(game);
+
+    game->score.level = options->initial_level;
+    game->score.current_highscore = highscore;
+
+    /* setup the initial timeout (by reducing all deltas upto initial_level */
+    game->timeout = INITIAL_TIMEOUT;
+    for (i = 1; i <= options->initial_level; i++)
+        game->timeout -= TIMEOUT_DELTA(i);
+
+    /* initialize the next block */
+    game->next_block = randomizer_next(&game->randomizer);
+    game->next_block_orientation =
+        (degree_t)rng_below(&game->randomizer.rng, TOTAL_DEGREES);
+    game->hash ^= zobrist_next[game->next_block];
+}
+
+
+static void update_current_block(struct game_state *game)
+{
+    struct block *block = &game->current;
+
+    block->color = 1;			/* not used currently */
+    block->type = game->next_block;
+    block->orientation = game->next_block_orientation;
+
+    game->hash ^= zobrist_next[game->next_block];
+    game->next_block = randomizer_next(&game->randomizer);
+    game->next_block_orientation =
+        (degree_t)rng_below(&game->randomizer.rng, TOTAL_DEGREES);
+    game->hash ^= zobrist_next[game->next_block];
+}
+
+
+/*
+ * Deal the given block next, in place of the one the randomizer dealt, for
+ * searches over the blocks that might come; the randomizer is left as it is.
+ */
+void game_set_next_block(struct game_state *game, block_t type,
+        degree_t orientation)
+{
+    game->hash ^= zobrist_next[game->next_block] ^ zobrist_next[type];
+    game->next_block = type;
+    game->next_block_orientation = orientation;
+}
+
+
+int game_apply_input(struct game_state *game, input_t input)
+{
+    if (game->game_over || !game->has_current)
+        return FAILURE;
+
+    return game_move_block(game, &game->current, input);
+}
+
+/*
+ * Move the given block the way the input moves the current one, if it fits
+ * on the board. The block needn't be on the board, so that moves can be
+ * tried out without changing the game at all.
+ */
+int game_move_block(const struct game_state *game, struct block *block,
+        input_t input)
+{
+    action_t action;
+
+    switch (input) {
+        case INPUT_MOVE_LEFT:
+            action = ACTION_MOVE_LEFT;
+            break;
+        case INPUT_MOVE_RIGHT:
+            action = ACTION_MOVE_RIGHT;
+            break;
+        case INPUT_MOVE_DOWN:
+            action = ACTION_MOVE_DOWN;
+            break;
+        case INPUT_MOVE_UP_DROP:
+            action = ACTION_MOVE_UP_DROP;
+            break;
+        case INPUT_ROTATE_LEFT:
+            action = ACTION_ROTATE_LEFT;
+            break;
+        case INPUT_ROTATE_RIGHT:
+            action = ACTION_ROTATE_RIGHT;
+            break;
+        default:                /* nothing the engine can act upon */
+            return FAILURE;
+    }
+
+    return move_block(game, block, action);
+}
+
+
+/*
+ * One step of gravity: spawn a new block, move the current one down, or lock
+ * it and clear rows. The cleared rows are reported through cleared_rows, see
+ * clear_even_rows().
+ */
+int game_gravity_tick(struct game_state *game, int *cleared_rows)
+{
+    int num_rows;
+    int events = 0;
+
+    if (game->game_over)
+        return GAME_EVENT_GAME_OVER;
+
+    game->cleared_count = 0;
+
+    if (!game->has_current) {
+        update_current_block(game);
+
+        if (move_block(game, &game->current, ACTION_PLACE_NEW) == FAILURE) {
+            game->game_over = 1;
+            return GAME_EVENT_GAME_OVER;
+        }
+
+        game->has_current = 1;
+        game->hash ^= zobrist_current[game->current.type];
+        return GAME_EVENT_SPAWNED;
+    }
+
+    /* try moving the block downwards */
+    if (move_block(game, &game->current, ACTION_MOVE_DOWN) == SUCCESS)
+        return GAME_EVENT_MOVED;
+
+    /* freeze this block in the game board */
+    freeze_block(game, &game->current);
+    game->has_current = 0;
+    game->hash ^= zobrist_current[game->current.type];
+    events |= GAME_EVENT_LOCKED;
+
+    num_rows = clear_even_rows(game, cleared_rows);
+    game->cleared_count = num_rows;
+    if (num_rows) {
+        events |= GAME_EVENT_ROWS_CLEARED;
+
+        /* see if the level has changed */
+        if (update_score_level(game, num_rows))
+            events |= GAME_EVENT_LEVEL_UP;
+    }
+
+    assert(game->hash == full_hash(game));
+    return events;
+}
+
+
+int game_cell(const struct game_state *game, int x, int y)
+{
+    return !!(game->board[y + 1] & BOARD_CELL_BIT(x));
+}
+
+/* all of the cells of row y at once, cell x being BOARD_CELL_BIT(x) */
+row_t game_row(const struct game_state *game, int y)
+{
+    return game->board[y + 1] & ~BOARD_WALLS;
+}
+
+/* the rows of the board as they look on screen, the current block included */
+void game_render_rows(const struct game_state *game, row_t *rows)
+{
+    int i, x, y;
+    const struct block *block = game_current_block(game);
+
+    for (i = 0; i < GAME_BOARD_HEIGHT; i++)
+        rows[i] = game_row(game, i);
+
+    if (block) {
+        for (i = 0; i < ARRAY_LEN(block->position->pos); i++) {
+            x = block->origin.x + block->position->pos[i].x;
+            y = block->origin.y + block->position->pos[i].y;
+            if (y >= 0 && y < GAME_BOARD_HEIGHT)
+                rows[y] |= BOARD_CELL_BIT(x);
+        }
+    }
+}
+
+
+const struct block *game_current_block(const struct game_state *game)
+{
+    return game->has_current ? &game->current : NULL;
+}
+
+
+/*
+ * The number of rows the given block can fall before it lands. As long as
+ * the block is above the surface of every column it covers, this is just the
+ * smallest gap between its bottom profile and the column heights. Only a
+ * block tucked under an overhang has to be walked down row by row.
+ */
+int game_drop_distance(const struct game_state *game,
+        const struct block *block)
+{
+    int i;
+    int distance = GAME_BOARD_HEIGHT;
+    const struct piece_shape *shape =
+        &piece_shapes[block->type][block->orientation];
+    struct block newblock;
+
+    for (i = 0; i <= shape->x1 - shape->x0; i++) {
+        int x = block->origin.x + shape->x0 + i;
+        int gap = GAME_BOARD_HEIGHT - game->col_heights[x] - 1 -
+            (block->origin.y + shape->bottom[i]);
+
+        if (gap < 0)
+            break;              /* below the surface of this column */
+        if (gap < distance)
+            distance = gap;
+    }
+
+    if (i > shape->x1 - shape->x0)
+        return distance;
+
+    newblock = *block;
+    do {
+        newblock.origin.y++;
+    } while (test_movement(game, &newblock) == SUCCESS);
+
+    return newblock.origin.y - block->origin.y - 1;
+}
+
+
+static int move_block(const struct game_state *game, struct block *block,
+        action_t movement)
+{
+    int result;
+    struct block newblock = *block;	/* start with a copy of the given block */
+
+    if ((unsigned)movement < TOTAL_MOVEMENTS)
+        COUNT(moves[movement]);
+
+    /* apply the requested operation */
+    switch (movement) {
+        case ACTION_MOVE_LEFT:
+            --newblock.origin.x;
+            assert(newblock.origin.x < GAME_BOARD_WIDTH);
+            break;
+        case ACTION_MOVE_RIGHT:
+            ++newblock.origin.x;
+            assert(newblock.origin.x < GAME_BOARD_WIDTH);
+            break;
+        case ACTION_MOVE_DOWN:
+            ++newblock.origin.y;
+            assert(newblock.origin.y < GAME_BOARD_HEIGHT);
+            break;
+        case ACTION_MOVE_UP_DROP:
+            newblock.origin.y += game_drop_distance(game, &newblock);
+            assert(newblock.origin.y < GAME_BOARD_HEIGHT);
+            break;
+        case ACTION_ROTATE_LEFT:
+            if (newblock.orientation == DEG_0)
+                newblock.orientation = TOTAL_DEGREES - 1;
+            else
+                --newblock.orientation;
+            newblock.position = &positions[newblock.type][newblock.orientation];
+            break;
+        case ACTION_ROTATE_RIGHT:
+            newblock.orientation = (newblock.orientation + 1) % TOTAL_DEGREES;
+            newblock.position = &positions[newblock.type][newblock.orientation];
+            break;
+        case ACTION_PLACE_NEW:
+            newblock.origin = starting_position;
+            newblock.position = &positions[newblock.type][newblock.orientation];
+            break;			/* no change in position requested */
+
+        default:
+            return FAILURE;
+    }
+
+    /* check if the new changes can be applied */
+    result = test_movement(game, &newblock);
+
+    if (result == SUCCESS)
+        *block = newblock;		/* apply the new change */
+
+    return result;
+}
+
+static int test_movement(const struct game_state *game, struct block *block)
+{
+    int i;
+    row_t collision = 0;
+    const struct piece_shape *shape =
+        &piece_shapes[block->type][block->orientation];
+    int shift = block->origin.x + shape->x0 + 1;    /* board bit of x0 */
+    int row = block->origin.y + 1;                  /* board row of grid 0 */
+
+    COUNT(tests);
+
+    /* blocks beyond the walls and the sentinel rows can never fit */
+    if ((unsigned)shift > GAME_BOARD_WIDTH + 1 ||
+            (unsigned)(row + shape->y0) > GAME_BOARD_HEIGHT + 1 ||
+            (unsigned)(row + shape->y1) > GAME_BOARD_HEIGHT + 1) {
+        COUNT(rejected);
+        return FAILURE;
+    }
+
+    /*
+     * A block sticking out past the right wall can lose cells off the top of
+     * the row_t, or have them land on bits no board row ever sets. That's
+     * safe only because every block has a cell in every column of its
+     * bounding box (mkpieces checks): one of them is then on the wall.
+     */
+    for (i = shape->y0; i <= shape->y1; i++)
+        collision |= game->board[row + i] & (row_t)(shape->rows[i] << shift);
+    assert(shift + shape->x1 - shape->x0 <= GAME_BOARD_WIDTH || collision);
+
+    if (collision) {
+        COUNT(rejected);
+        return FAILURE;
+    }
+    return SUCCESS;
+}
+
+
+static int update_score_level(struct game_state *game, int num_rows)
+{
+    int has_level_changed = 0;
+    struct game_score *score = &game->score;
+
+    //score->score += (score->level + SCORE_CLEAR_ROW) * num_rows * num_rows;
+    score->score += score->level * num_rows * num_rows * BASE_SCORE_PER_ROW;
+    if (score->score > score->current_highscore)
+        score->current_highscore = score->score;
+
+    score->total_rows += num_rows;
+    score->rows_cleared += num_rows;
+
+    if (score->rows_cleared >= MAX_ROWS_PER_LEVEL) {
+        if (game->options.increase_difficulty &&
+                score->level < DIFFICULTY_LEVEL_MAX)
+            game->timeout -= TIMEOUT_DELTA(score->level);
+
+        if (game->options.clear_on_new_level)
+            reset_game_board(game);
+
+        score->level++;
+        score->rows_cleared = 0;
+        has_level_changed = 1;
+    }
+
+    return has_level_changed;
+}
+
+
+static void freeze_block(struct game_state *game, struct block *current)
+{
+    int i;
+    unsigned int cells;
+    const struct piece_shape *shape =
+        &piece_shapes[current->type][current->orientation];
+    int shift = current->origin.x + shape->x0 + 1;
+    int row = current->origin.y + 1;
+
+    COUNT(freezes);
+
+    /* fuse the current block with the board, one row at a time */
+    for (i = shape->y0; i <= shape->y1; i++) {
+        row_t mask = (row_t)(shape->rows[i] << shift);
+        int height = GAME_BOARD_HEIGHT + 1 - (row + i);
+
+        assert(!(game->board[row + i] & mask));
+        game->board[row + i] |= mask;
+        game->hash ^= zobrist_row(row + i, mask);
+        game->row_fill[row + i] += __builtin_popcount(mask);
+
+        if (game->row_fill[row + i] == GAME_BOARD_WIDTH)
+            game->full_rows |= (uint64_t)1 << (row + i);
+
+        /* raise the columns this row of the block lands on */
+        for (cells = shape->rows[i]; cells; cells &= cells - 1) {
+            int x = current->origin.x + shape->x0 + __builtin_ctz(cells);
+
+            if (height > game->col_heights[x])
+                game->col_heights[x] = height;
+        }
+    }
+
+    if (row + shape->y0 < game->top_row)
+        game->top_row = row + shape->y0;
+
+    assert(game->top_row > 0);
+}
+
+
+/*
+ * Remove every full row in a single downward sweep: each row between the
+ * lowest full row and top_row is copied at most once, straight to where it
+ * ends up. The screen rows of the cleared rows are stored, bottom up, in
+ * cleared_rows (if given), which must have room for GAME_BOARD_HEIGHT rows.
+ */
+static int clear_even_rows(struct game_state *game, int *cleared_rows)
+{
+    int i;
+    int src, dst;
+    int count = 0;
+    row_t *board = game->board;
+    uint8_t *row_fill = game->row_fill;
+    uint64_t full_rows = game->full_rows;
+
+    if (!full_rows) {
+        COUNT(clears[0]);
+        return 0;
+    }
+
+    /* start at the lowest full row, nothing below it moves */
+    dst = 63 - __builtin_clzll(full_rows);
+
+    for (src = dst; src >= game->top_row; src--) {
+        if (full_rows & ((uint64_t)1 << src)) {
+            if (cleared_rows)
+                cleared_rows[count] = src - 1;  /* save the screen row */
+            game->hash ^= zobrist_row(src, board[src]);
+            count++;
+            continue;
+        }
+
+        /* the cells of a row that moves change keys */
+        if (dst != src)
+            game->hash ^= zobrist_row(src, board[src]) ^
+                zobrist_row(dst, board[src]);
+        board[dst] = board[src];
+        row_fill[dst] = row_fill[src];
+        dst--;
+    }
+
+    /* whatever is left above the compacted rows is now empty */
+    for (; dst >= game->top_row; dst--) {
+        board[dst] = BOARD_WALLS;
+        row_fill[dst] = 0;
+    }
+
+    game->top_row += count;
+    game->full_rows = 0;
+    COUNT(clears[count < ENGINE_MAX_CLEARED ? count : ENGINE_MAX_CLEARED]);
+
+    /*
+     * columns can only sink, so walk each one down from its old height to
+     * the first filled cell; that is count rows plus any holes uncovered.
+     */
+    for (i = 0; count && i < GAME_BOARD_WIDTH; i++) {
+        int height = game->col_heights[i];
+
+        while (height > 0 &&
+                !(board[GAME_BOARD_HEIGHT + 1 - height] & BOARD_CELL_BIT(i)))
+            height--;
+        game->col_heights[i] = height;
+    }
+
+    return count;
+}
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
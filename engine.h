@@ -0,0 +1,267 @@
+#ifndef __ENGINE_H__
+#define __ENGINE_H__
+
+#include <stdint.h>
+
+/*
+ * The headless game engine (libtetriz). Everything the game needs to know
+ * about a single game lives in a struct game_state, so any number of games
+ * can run side by side in one process. Nothing in here depends on ncurses.
+ */
+
+#define DIFFICULTY_LEVEL_MIN	1
+#define DIFFICULTY_LEVEL_MAX	25
+
+#define GAME_BOARD_HEIGHT		20
+#define GAME_BOARD_WIDTH		12
+
+#define INITIAL_TIMEOUT		1000
+
+#define ARRAY_LEN(arr)	((int)(sizeof (arr) / sizeof (*(arr))))
+
+/*
+ * The board is stored as one bitmask per row. Bit 0 and bit
+ * (GAME_BOARD_WIDTH + 1) are the side walls, which are always set, and the
+ * cell at column x lives in bit (x + 1). Rows 0 and (GAME_BOARD_HEIGHT + 1)
+ * are solid sentinel rows above and below the playing field.
+ */
+typedef uint16_t row_t;
+
+#define BOARD_CELL_BIT(x)	((row_t)(1u << ((x) + 1)))
+#define BOARD_WALLS			((row_t)(1u | (1u << (GAME_BOARD_WIDTH + 1))))
+#define BOARD_FULL_ROW		((row_t)((1u << (GAME_BOARD_WIDTH + 2)) - 1))
+
+_Static_assert(GAME_BOARD_WIDTH + 2 <= 16, "a board row must fit in a row_t");
+_Static_assert(GAME_BOARD_HEIGHT + 2 <= 64, "full_rows must fit in 64 bits");
+
+enum { SUCCESS, FAILURE };
+
+typedef enum {
+    BLOCK_SQUARE,
+    BLOCK_LINE,
+    BLOCK_TEE,
+    BLOCK_ZEE_1,
+    BLOCK_ZEE_2,
+    BLOCK_ELL_1,
+    BLOCK_ELL_2,
+
+    TOTAL_BLOCKS,
+} block_t;
+
+typedef enum {
+    DEG_0,
+    DEG_90,
+    DEG_180,
+    DEG_270,
+    TOTAL_DEGREES
+} degree_t;
+
+struct point {
+    int x;
+    int y;
+};
+
+struct position {
+    struct point pos[4];
+};
+
+struct block {
+    block_t type;
+    struct point origin;
+    degree_t orientation;
+    int color;
+    const struct position *position;
+};
+
+typedef enum {
+    RANDOMIZER_UNIFORM,         /* every block equally likely, every time */
+    RANDOMIZER_BAG,             /* shuffled bags of one of each block */
+    RANDOMIZER_HISTORY,         /* reroll blocks dealt recently */
+
+    TOTAL_RANDOMIZERS
+} randomizer_t;
+
+struct game_options {
+    int increase_difficulty;
+    int display_colors;
+    int initial_level;
+    int clear_on_new_level;
+    randomizer_t randomizer;
+};
+
+struct game_score {
+    int level;
+    int rows_cleared;
+    int total_rows;
+    int score;
+    int current_highscore;
+};
+
+typedef enum {
+    INPUT_TIMEOUT,
+    INPUT_INVALID,
+    INPUT_MOVE_LEFT,
+    INPUT_MOVE_RIGHT,
+    INPUT_MOVE_DOWN,
+    INPUT_MOVE_UP_DROP,
+    INPUT_ROTATE_LEFT,
+    INPUT_ROTATE_RIGHT,
+    INPUT_PAUSE_QUIT,
+} input_t;
+
+struct game_rng {
+    uint32_t s[4];
+};
+
+struct randomizer {
+    randomizer_t type;
+    struct game_rng rng;
+    block_t bag[TOTAL_BLOCKS];
+    int bag_left;
+    block_t history[4];
+};
+
+/* events reported by game_gravity_tick() */
+enum {
+    GAME_EVENT_SPAWNED      = 1 << 0,   /* a new block entered the board */
+    GAME_EVENT_MOVED        = 1 << 1,   /* the current block fell a row */
+    GAME_EVENT_LOCKED       = 1 << 2,   /* the current block was frozen */
+    GAME_EVENT_ROWS_CLEARED = 1 << 3,   /* see cleared_count */
+    GAME_EVENT_LEVEL_UP     = 1 << 4,
+    GAME_EVENT_GAME_OVER    = 1 << 5,
+};
+
+struct game_state {
+    _Alignas(64) row_t board[GAME_BOARD_HEIGHT + 2];  /* one cache line */
+    int top_row;                /* highest board row with a filled cell */
+    uint64_t full_rows;         /* bit i is set if board[i] is full */
+    uint8_t row_fill[GAME_BOARD_HEIGHT + 2];    /* filled cells per row */
+    uint8_t col_heights[GAME_BOARD_WIDTH];  /* highest filled cell + 1 */
+
+    struct block current;
+    int has_current;            /* 0 if there's no block on the board */
+    block_t next_block;
+    degree_t next_block_orientation;
+
+    struct game_options options;
+    struct game_score score;
+    int timeout;                /* gravity interval (in ms) */
+    int game_over;
+
+    struct randomizer randomizer;   /* deals the blocks */
+
+    int cleared_count;          /* rows cleared by the last lock */
+
+    uint64_t hash;              /* see zobrist_cells[] */
+};
+
+/*
+ * Per-orientation lookup data derived from positions[] at build time (see
+ * mkpieces.c). rows[dy] holds the cells in grid row dy as a mask whose bit 0
+ * is grid column x0, bottom[i] is the lowest grid row used in column
+ * (x0 + i), or -1, and canonical is the first orientation with exactly the
+ * same cells.
+ */
+struct piece_shape {
+    row_t rows[4];
+    int8_t x0, x1, y0, y1;          /* bounding box within the 4x4 grid */
+    int8_t bottom[4];
+    degree_t canonical;
+};
+
+extern const struct position positions[TOTAL_BLOCKS][TOTAL_DEGREES];
+extern const struct piece_shape piece_shapes[TOTAL_BLOCKS][TOTAL_DEGREES];
+
+/*
+ * The Zobrist hash of a game (game_state.hash) is the XOR of a random key
+ * for every filled cell of the board, one for the type of the current block
+ * while there is one, and one for the type of the next block. The engine
+ * keeps it up to date as blocks are locked and rows cleared, so that boards
+ * reached in different ways hash the same. The keys are generated at build
+ * time, see mkpieces.c.
+ */
+extern const uint64_t zobrist_cells[GAME_BOARD_HEIGHT][GAME_BOARD_WIDTH];
+extern const uint64_t zobrist_current[TOTAL_BLOCKS];
+extern const uint64_t zobrist_next[TOTAL_BLOCKS];
+
+/* the keys of the cells of board row row (1 for the top one) */
+static inline uint64_t zobrist_row(int row, row_t cells)
+{
+    uint64_t hash = 0;
+    unsigned int bits = (unsigned int)(cells & ~BOARD_WALLS) >> 1;
+
+    for (; bits; bits &= bits - 1)
+        hash ^= zobrist_cells[row - 1][__builtin_ctz(bits)];
+    return hash;
+}
+
+/* the distinct orientations of each block, canonical ones first */
+extern const int piece_rotations[TOTAL_BLOCKS];
+extern const degree_t piece_orientations[TOTAL_BLOCKS][TOTAL_DEGREES];
+
+/*
+ * A place the current block can come to rest in, with the inputs that take
+ * it there from where it is now, the last of them INPUT_MOVE_UP_DROP; see
+ * game_reachable_placements().
+ */
+#define PLACEMENT_PATH_MAX  64
+#define PLACEMENTS_MAX      256         /* plenty for any board */
+
+struct placement {
+    struct block block;                 /* where it ends up */
+    int length;
+    uint8_t path[PLACEMENT_PATH_MAX];   /* input_t values */
+};
+
+#ifdef TETRIZ_STATS
+/*
+ * What the engine did on the calling thread, counted with -DTETRIZ_STATS
+ * (see the Makefile); without it, nothing is counted at all. Each thread has
+ * counters of its own, so counting takes no atomics. See stats.h for how
+ * the game collects them.
+ */
+#define ENGINE_ACTIONS      7           /* the engine's moves, see engine.c */
+#define ENGINE_MAX_CLEARED  4           /* rows a single block can clear */
+
+struct engine_stats {
+    uint64_t moves[ENGINE_ACTIONS];     /* move_block() calls, by action */
+    uint64_t tests;                     /* test_movement() calls */
+    uint64_t rejected;                  /* ... that found a collision */
+    uint64_t freezes;                   /* freeze_block() calls */
+    uint64_t clears[ENGINE_MAX_CLEARED + 1];    /* by the rows cleared */
+};
+
+extern _Thread_local struct engine_stats engine_stats;
+extern const char *const engine_action_names[ENGINE_ACTIONS];
+#endif
+
+void game_init(struct game_state *game, const struct game_options *options,
+        int highscore, uint64_t seed);
+int game_apply_input(struct game_state *game, input_t input);
+int game_move_block(const struct game_state *game, struct block *block,
+        input_t input);
+int game_gravity_tick(struct game_state *game, int *cleared_rows);
+void game_set_next_block(struct game_state *game, block_t type,
+        degree_t orientation);
+
+int game_cell(const struct game_state *game, int x, int y);
+row_t game_row(const struct game_state *game, int y);
+void game_render_rows(const struct game_state *game, row_t *rows);
+const struct block *game_current_block(const struct game_state *game);
+int game_drop_distance(const struct game_state *game,
+        const struct block *block);
+int game_reachable_placements(const struct game_state *game,
+        struct placement *placements, int max);
+
+void rng_seed(struct game_rng *rng, uint64_t seed);
+uint32_t rng_next(struct game_rng *rng);
+unsigned int rng_below(struct game_rng *rng, unsigned int bound);
+
+void randomizer_init(struct randomizer *randomizer, randomizer_t type,
+        uint64_t seed);
+block_t randomizer_next(struct randomizer *randomizer);
+const char *randomizer_name(randomizer_t type);
+
+#endif	/* __ENGINE_H__ */
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
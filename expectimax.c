@@ -0,0 +1,289 @@
+#include "expectimax.h"
+
+#include <string.h>
+
+#define GAME_OVER_SCORE     -1e6        /* worse than any board */
+
+/* one of the seven blocks that could be dealt onto a board next */
+struct chance_task {
+    struct pool_task task;              /* first, see chance_run() */
+    struct expectimax *search;
+    const struct game_state *game;      /* with the last block locked in */
+    block_t type;
+    int depth;                          /* chance nodes left, this one too */
+    double value;
+};
+
+/* a place searched further: the board it leaves, and what that's worth */
+struct outcome {
+    struct game_state game;
+    uint64_t key;                       /* of the board alone */
+    int cached;                         /* found in the table */
+    double value;
+    struct chance_task chances[TOTAL_BLOCKS];
+};
+
+/* a place of the current block, at the root */
+struct root_task {
+    struct pool_task task;              /* first, see root_run() */
+    struct expectimax *search;
+    const struct game_state *game;
+    const struct block *block;
+    double value;
+};
+
+/* the whole search, run on the pool */
+struct search_task {
+    struct pool_task task;              /* first, see search_run() */
+    struct root_task *roots;
+    int count;
+};
+
+static double max_node(struct expectimax *search,
+        const struct game_state *game, int depth);
+
+/*
+ * The indices of the best width of the count placements on the board, as
+ * bot_evaluate() scores them, the best first, into best; returns how many.
+ */
+static int best_placements(const struct game_state *game,
+        const struct placement *placements, int count, int width,
+        const struct bot_weights *weights, int *best)
+{
+    int i, j;
+    int kept = 0;
+    double score;
+    double scores[EXPECTIMAX_WIDTH_MAX];
+
+    for (i = 0; i < count; i++) {
+        score = bot_evaluate(game, &placements[i].block, weights);
+        if (kept == width) {
+            if (score <= scores[kept - 1])
+                continue;
+            kept--;
+        }
+
+        for (j = kept; j > 0 && scores[j - 1] < score; j--) {
+            scores[j] = scores[j - 1];
+            best[j] = best[j - 1];
+        }
+        scores[j] = score;
+        best[j] = i;
+        kept++;
+    }
+
+    return kept;
+}
+
+static void chance_run(struct pool_task *task)
+{
+    struct chance_task *chance = (struct chance_task *)task;
+    struct game_state game = *chance->game;
+
+    game_set_next_block(&game, chance->type, DEG_0);
+    if (game_gravity_tick(&game, NULL) & GAME_EVENT_GAME_OVER)
+        chance->value = GAME_OVER_SCORE;
+    else
+        chance->value = max_node(chance->search, &game, chance->depth - 1);
+}
+
+/*
+ * The most the current block can make of the board: the best score of its
+ * places if there are no chance nodes left (depth), and otherwise the best
+ * of the places searched on, each worth the lines it clears and then the
+ * average over the blocks that might come after it.
+ */
+static double max_node(struct expectimax *search,
+        const struct game_state *game, int depth)
+{
+    int i, t, count, kept;
+    int best[EXPECTIMAX_WIDTH_MAX];
+    double value, sum, max = GAME_OVER_SCORE;
+    atomic_int pending = 0;
+    struct tt_data data;
+    struct outcome *outcome;
+    struct chance_task *chance;
+    struct placement placements[PLACEMENTS_MAX];
+    struct outcome outcomes[EXPECTIMAX_WIDTH_MAX];
+    const struct bot_weights *weights = search->weights;
+
+    count = game_reachable_placements(game, placements, PLACEMENTS_MAX);
+    search->counters[pool_worker_index()].nodes += count;
+
+    if (!depth) {
+        for (i = 0; i < count; i++) {
+            value = bot_evaluate(game, &placements[i].block, weights);
+            if (value > max)
+                max = value;
+        }
+        return max;
+    }
+
+    kept = best_placements(game, placements, count, search->width, weights,
+            best);
+
+    /* every chance node not in the table yet is up for grabs at once */
+    for (i = 0; i < kept; i++) {
+        outcome = &outcomes[i];
+        outcome->game = *game;
+        outcome->game.current = placements[best[i]].block;
+        game_gravity_tick(&outcome->game, NULL);    /* it's resting: locks */
+
+        outcome->key = outcome->game.hash ^
+            zobrist_next[outcome->game.next_block];
+        outcome->cached = tt_probe(&search->table, outcome->key, &data) ==
+            SUCCESS && data.depth == depth;
+        if (outcome->cached) {
+            outcome->value = data.value;
+            continue;
+        }
+
+        for (t = 0; t < TOTAL_BLOCKS; t++) {
+            chance = &outcome->chances[t];
+            chance->task.run = chance_run;
+            chance->search = search;
+            chance->game = &outcome->game;
+            chance->type = t;
+            chance->depth = depth;
+            pool_spawn(&chance->task, &pending);
+        }
+    }
+
+    pool_wait(&pending);
+
+    for (i = 0; i < kept; i++) {
+        outcome = &outcomes[i];
+        if (!outcome->cached) {
+            for (sum = 0, t = 0; t < TOTAL_BLOCKS; t++)
+                sum += outcome->chances[t].value;
+
+            /* as the table has it, so that a hit changes nothing */
+            memset(&data, 0, sizeof (data));
+            data.value = (float)(sum / TOTAL_BLOCKS);
+            data.depth = depth;
+            tt_store(&search->table, outcome->key, &data);
+            outcome->value = data.value;
+        }
+
+        value = weights->lines * outcome->game.cleared_count +
+            outcome->value;
+        if (value > max)
+            max = value;
+    }
+
+    return max;
+}
+
+/* a place of the current block: lock it in, and the next block is known */
+static void root_run(struct pool_task *task)
+{
+    struct root_task *root = (struct root_task *)task;
+    struct expectimax *search = root->search;
+    struct game_state game = *root->game;
+
+    game.current = *root->block;
+    game_gravity_tick(&game, NULL);
+    root->value = search->weights->lines * game.cleared_count;
+
+    if (game_gravity_tick(&game, NULL) & GAME_EVENT_GAME_OVER)
+        root->value += GAME_OVER_SCORE;
+    else
+        root->value += max_node(search, &game, search->depth);
+}
+
+static void search_run(struct pool_task *task)
+{
+    int i;
+    atomic_int pending = 0;
+    struct search_task *top = (struct search_task *)task;
+
+    for (i = 0; i < top->count; i++)
+        pool_spawn(&top->roots[i].task, &pending);
+    pool_wait(&pending);
+}
+
+/*
+ * A search over width places per block, depth blocks past the preview, on
+ * threads threads (the caller's included); FAILURE if they can't be had.
+ */
+int expectimax_init(struct expectimax *search, int threads, int width,
+        int depth)
+{
+    memset(search, 0, sizeof (*search));
+    search->width = width < 1 ? 1 :
+        width > EXPECTIMAX_WIDTH_MAX ? EXPECTIMAX_WIDTH_MAX : width;
+    search->depth = depth < 0 ? 0 : depth;
+
+    if (tt_init(&search->table, EXPECTIMAX_TABLE_BITS) == FAILURE)
+        return FAILURE;
+
+    if (pool_init(&search->pool, threads) == FAILURE) {
+        tt_free(&search->table);
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+void expectimax_free(struct expectimax *search)
+{
+    pool_free(&search->pool);
+    tt_free(&search->table);
+}
+
+/* the placement of the current block worth the most, FAILURE if none is */
+int expectimax_choose(struct expectimax *search,
+        const struct game_state *game, const struct bot_weights *weights,
+        struct placement *placement)
+{
+    int i, count, kept;
+    int best = 0;
+    int indices[EXPECTIMAX_WIDTH_MAX];
+    struct placement placements[PLACEMENTS_MAX];
+    struct root_task roots[EXPECTIMAX_WIDTH_MAX];
+    struct search_task top;
+
+    count = game_reachable_placements(game, placements, PLACEMENTS_MAX);
+    if (!count)
+        return FAILURE;
+
+    kept = best_placements(game, placements, count, search->width, weights,
+            indices);
+    for (i = 0; i < kept; i++) {
+        roots[i].task.run = root_run;
+        roots[i].search = search;
+        roots[i].game = game;
+        roots[i].block = &placements[indices[i]].block;
+    }
+
+    search->weights = weights;
+    search->counters[0].nodes += count;
+    tt_new_search(&search->table);
+
+    top.task.run = search_run;
+    top.roots = roots;
+    top.count = kept;
+    pool_run(&search->pool, &top.task);
+
+    /* on a tie, the one that scored better on its own */
+    for (i = 1; i < kept; i++) {
+        if (roots[i].value > roots[best].value)
+            best = i;
+    }
+
+    *placement = placements[indices[best]];
+    return SUCCESS;
+}
+
+/* the nodes looked at by every search so far, while none is under way */
+uint64_t expectimax_nodes(const struct expectimax *search)
+{
+    int i;
+    uint64_t nodes = 0;
+
+    for (i = 0; i < POOL_THREADS_MAX; i++)
+        nodes += search->counters[i].nodes;
+    return nodes;
+}
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
@@ -0,0 +1,58 @@
+#ifndef __EXPECTIMAX_H__
+#define __EXPECTIMAX_H__
+
+#include "bot.h"
+#include "pool.h"
+#include "tt.h"
+
+/*
+ * A bot that plays for the blocks it can't see yet as well: an expectimax
+ * search. The current block and the one in the preview are known, so it
+ * takes the best of their places (max nodes), but every block after those
+ * could be any of the seven, so what a board is worth then is the average
+ * over them (a chance node) of the best that block can do on it. The boards
+ * depth blocks past the preview are scored as in bot.h. The blocks are taken
+ * to be dealt uniformly, as the default randomizer does, and in their first
+ * orientation.
+ *
+ * Only the best width places of a block (as bot.h scores them) are searched
+ * any deeper, as the rest are hardly ever worth it; at the bottom, all of
+ * them are. What a chance node averages out to is kept in a transposition
+ * table (see tt.h), since the current and the next block can often be swapped
+ * around for the same board.
+ *
+ * The places of the current block are searched side by side, on a work
+ * stealing pool of threads (see pool.h), and so are the seven blocks of
+ * every chance node. Each thread counts the nodes it looked at (the places
+ * listed for a block) on a cache line of its own.
+ */
+
+#define EXPECTIMAX_WIDTH_MAX        16
+#define EXPECTIMAX_DEFAULT_WIDTH    6
+#define EXPECTIMAX_DEFAULT_DEPTH    1   /* blocks past the preview */
+#define EXPECTIMAX_TABLE_BITS       16  /* 4 MB of buckets */
+
+struct expectimax_counter {
+    _Alignas(64) uint64_t nodes;
+};
+
+struct expectimax {
+    int width;
+    int depth;
+    const struct bot_weights *weights;  /* for the search under way */
+    struct pool pool;
+    struct transposition_table table;
+    struct expectimax_counter counters[POOL_THREADS_MAX];
+};
+
+int expectimax_init(struct expectimax *search, int threads, int width,
+        int depth);
+void expectimax_free(struct expectimax *search);
+int expectimax_choose(struct expectimax *search,
+        const struct game_state *game, const struct bot_weights *weights,
+        struct placement *placement);
+uint64_t expectimax_nodes(const struct expectimax *search);
+
+#endif	/* __EXPECTIMAX_H__ */
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
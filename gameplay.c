@@ -1,187 +1,345 @@
 #include "tetriz.h"
+#include "replay.h"
+#include "input_queue.h"
+#include "snapshot.h"
+#include "keyboard.h"
+#include "latency.h"
+#include "stats.h"
 #include <pthread.h>
+#include <semaphore.h>
 
 #include <time.h>
-#include <assert.h>
+#include <poll.h>
+#include <stdio.h>
+#include <errno.h>
 #include <string.h>
-#include <stdlib.h>
-
-#define BASE_SCORE_PER_ROW  10		/* score awarded for each row cleared */
-#define MAX_ROWS_PER_LEVEL	20		/* rows to clear before next level */
-#define INITIAL_TIMEOUT		1000
-
-/* formula for calculating timeout reduction delta with each new level */
-#define TIMEOUT_DELTA(level)    ((DIFFICULTY_LEVEL_MAX - (level) + 1) * 3)
-
-typedef enum {
-    ACTION_MOVE_UP_DROP,            /* drop the block at the floor */
-    ACTION_MOVE_LEFT,
-    ACTION_MOVE_RIGHT,
-    ACTION_MOVE_DOWN,
-    ACTION_ROTATE_LEFT,
-    ACTION_ROTATE_RIGHT,
-    ACTION_PLACE_NEW,
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+/*
+ * A game is played by three threads. The main thread only reads the
+ * keyboard, and queues up what it reads. The game thread owns the game
+ * state: it sleeps until either the next gravity step is due, or the reader
+ * pokes it through wake_fd, then applies all of the queued inputs in order
+ * and publishes one snapshot of the result. The render thread draws the
+ * latest snapshot, at most RENDER_FPS times a second. So no key ever waits
+ * for a draw before being read, and the game never waits for the terminal.
+ *
+ * Only cleared rows hold the game up: it stands still for exactly as long
+ * as they take to animate away (see effects_duration()), while the render
+ * thread plays that animation a frame at a time.
+ */
+
+#define RENDER_FPS          60
+#define INPUT_BATCH         32          /* the most keys read in one go */
+#define READ_TIMEOUT        1000        /* ms, to notice the game is over */
+#define CLEAR_ANIMATION     ANIMATION_CLEARED_ROWS_3
+#define LATENCY_INPUTS      256         /* read times kept, see latency.h */
+
+/*
+ * What cleared rows bring on the screen: the rows animated away, the level
+ * banner if the level went up, and then the board as it is now. Whoever
+ * runs the screen steps through it with effects_update().
+ */
+struct clear_effects {
+    int active;
+    int level_up;
+    struct animation animation;
+    struct timespec start;              /* of the current animation */
+    struct game_score score;
+    row_t rows[GAME_BOARD_HEIGHT];      /* the board once it's all done */
+    struct timespec done;               /* when it was last over */
+};
 
-    TOTAL_MOVEMENTS
-} action_t;
+/* keys read off the terminal in one go, see next_input() */
+struct key_batch {
+    input_t inputs[INPUT_BATCH];
+    int count;
+    int next;
+    struct timespec arrival;            /* when they came in */
+};
 
 struct thread_data {
-    struct block *current;
-    int game_over;
+    struct game_state *game;
+    atomic_int game_over;
     int new_highscore;
-    pthread_mutex_t lock;
+    int user_quit;                  /* chosen by the reader, in the dialog */
     pthread_t thread_id;
-    int block_dropped_ignore_input;
-    /* 
-     * XXX: the reason behind the block_dropped_ignore_input is as follows:
-     *      when a block is dropped, we want to make sure that it can not be 
-     *      moved by the user (this can happen if the user hits some key, and 
-     *      the main thread catches it before the other thread can freeze the 
-     *      block). The solution, this flag, is an ugly hack to achive the same.
-     */
+    struct replay *replay;          /* NULL unless the game is recorded */
+    struct timespec start;          /* when the game started */
+    struct input_queue queue;       /* from the reader to the game thread */
+    uint64_t inputs;                /* applied so far, by the game thread */
+    struct keyboard keyboard;       /* with raw_input, instead of curses */
+    struct key_batch keys;          /* with raw_input, in the event loop */
+    int wake_fd;                    /* an eventfd, poked after every input */
+    sem_t paused;                   /* the game thread is out of the way */
+    sem_t resumed;                  /* the reader is done with the dialog */
+
+    pthread_t render_thread_id;
+    struct snapshot_buffer snapshots;   /* from the game to the renderer */
+    int render_fd;                  /* an eventfd, poked after every snapshot */
+    atomic_int render_stop;
+    pthread_mutex_t screen;         /* the renderer's, or the quit dialog's */
+    row_t locked_rows[GAME_BOARD_HEIGHT];   /* the board before a lock */
+#ifdef TETRIZ_LATENCY
+    /* when the inputs applied were read, by the count of them */
+    struct timespec read[LATENCY_INPUTS];
+#endif
 };
 
-static int move_block(struct block *block, action_t movement);
-static inline struct block *update_current_block(struct block *block);
-static void freeze_block(struct block *current);
-static int clear_even_rows(void);
 static void *worker_thread_fn(void *);
-static int test_movement(struct block *block);
-static int update_score_level(struct game_score *score, int num_rows, 
-        int *timeout);
-static void reset_game_board(void);
+static void *render_thread_fn(void *);
 static void play_game(struct thread_data *data);
+static int run_threads(struct thread_data *data);
+static int run_event_loop(struct thread_data *data);
+static void draw_tick_events(struct game_state *game, int events,
+        const int *cleared_rows, const row_t *locked_rows,
+        struct clear_effects *effects);
 
-int board[GAME_BOARD_HEIGHT + 2][GAME_BOARD_WIDTH + 2];
 struct game_options game_options = {
     1,                                  /* increase difficulty = "yeah" */
     0,                                  /* display_colors = "nope" */
     1,                                  /* initial_level */
     0,                                  /* clear_on_new_level = "nope" */
+    RANDOMIZER_UNIFORM,                 /* randomizer */
 };
 
 static int global_highscore = 0;
-static block_t next_block = -1;
-static degree_t next_block_orientation = -1;
-static struct block current_block;
-
-static const struct point starting_position = { 4, 0 };
-const struct position positions[TOTAL_BLOCKS][TOTAL_DEGREES] = {
-    /* BLOCK_SQUARE */
-    {
-        { { { 1, 1 }, { 2, 1 }, { 1, 2 }, { 2, 2 } } },			/* DEG_0 */
-        { { { 1, 1 }, { 2, 1 }, { 1, 2 }, { 2, 2 } } },			/* DEG_90 */
-        { { { 1, 1 }, { 2, 1 }, { 1, 2 }, { 2, 2 } } },			/* DEG_180 */
-        { { { 1, 1 }, { 2, 1 }, { 1, 2 }, { 2, 2 } } },			/* DEG_270 */
-    }, 
-    /* BLOCK_LINE */
-    {
-        { { { 0, 1 }, { 1, 1 }, { 2, 1 }, { 3, 1 } } },			/* DEG_0 */
-        { { { 2, 0 }, { 2, 1 }, { 2, 2 }, { 2, 3 } } },			/* DEG_90 */
-        { { { 0, 1 }, { 1, 1 }, { 2, 1 }, { 3, 1 } } },			/* DEG_180 */
-        { { { 2, 0 }, { 2, 1 }, { 2, 2 }, { 2, 3 } } },			/* DEG_270 */
-    }, 
-    /* BLOCK_TEE */
-    {
-        { { { 2, 0 }, { 1, 1 }, { 2, 1 }, { 3, 1 } } },			/* DEG_0 */
-        { { { 2, 0 }, { 2, 1 }, { 2, 2 }, { 3, 1 } } },			/* DEG_90 */
-        { { { 2, 2 }, { 1, 1 }, { 2, 1 }, { 3, 1 } } },			/* DEG_180 */
-        { { { 2, 0 }, { 2, 1 }, { 2, 2 }, { 1, 1 } } },			/* DEG_270 */
-    }, 
-    /* BLOCK_ZEE_1 */
-    {
-        { { { 2, 0 }, { 1, 1 }, { 2, 1 }, { 1, 2 } } },			/* DEG_0 */
-        { { { 1, 1 }, { 2, 1 }, { 2, 2 }, { 3, 2 } } },			/* DEG_90 */
-        { { { 2, 0 }, { 1, 1 }, { 2, 1 }, { 1, 2 } } },			/* DEG_180 */
-        { { { 1, 1 }, { 2, 1 }, { 2, 2 }, { 3, 2 } } },			/* DEG_270 */
-    }, 
-    /* BLOCK_ZEE_2 */
-    {
-        { { { 1, 0 }, { 1, 1 }, { 2, 1 }, { 2, 2 } } },			/* DEG_0 */
-        { { { 1, 1 }, { 2, 1 }, { 0, 2 }, { 1, 2 } } },			/* DEG_90 */
-        { { { 1, 0 }, { 1, 1 }, { 2, 1 }, { 2, 2 } } },			/* DEG_180 */
-        { { { 1, 1 }, { 2, 1 }, { 0, 2 }, { 1, 2 } } },			/* DEG_270 */
-    }, 
-    /* BLOCK_ELL_1 */
-    {
-        { { { 1, 0 }, { 1, 1 }, { 1, 2 }, { 2, 2 } } },			/* DEG_0 */
-        { { { 1, 1 }, { 2, 1 }, { 3, 1 }, { 1, 2 } } },			/* DEG_90 */
-        { { { 1, 0 }, { 2, 0 }, { 2, 1 }, { 2, 2 } } },			/* DEG_180 */
-        { { { 2, 0 }, { 0, 1 }, { 1, 1 }, { 2, 1 } } },			/* DEG_270 */
-    }, 
-    /* BLOCK_ELL_2 */
-    {
-        { { { 2, 0 }, { 2, 1 }, { 2, 2 }, { 1, 2 } } },			/* DEG_0 */
-        { { { 1, 0 }, { 1, 1 }, { 2, 1 }, { 3, 1 } } },			/* DEG_90 */
-        { { { 1, 0 }, { 2, 0 }, { 1, 1 }, { 1, 2 } } },			/* DEG_180 */
-        { { { 0, 1 }, { 1, 1 }, { 2, 1 }, { 2, 2 } } },			/* DEG_270 */
-    }, 
-};
 
+const char *record_path = NULL;     /* where to save replays of new games */
+int record_failed = 0;              /* set if a replay couldn't be saved */
+int event_loop = 0;                 /* play on one thread, see run_event_loop */
+int show_input_stats = 0;           /* print input_stats on the way out */
+int raw_input = 0;                  /* read the terminal without curses */
+struct input_stats input_stats;
+
+
+static uint64_t ms_between(const struct timespec *start,
+        const struct timespec *end)
+{
+    return (uint64_t)(end->tv_sec - start->tv_sec) * 1000 +
+        (end->tv_nsec - start->tv_nsec) / 1000000;
+}
+
+static uint64_t elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ms_between(start, &now);
+}
+
+static void add_ms(struct timespec *time, int ms)
+{
+    time->tv_sec += ms / 1000;
+    time->tv_nsec += (long)(ms % 1000) * 1000000;
+    if (time->tv_nsec >= 1000000000) {
+        time->tv_sec++;
+        time->tv_nsec -= 1000000000;
+    }
+}
 
-static void reset_game_board(void)
+/* milliseconds (rounded up) till the deadline, 0 or less once it's passed */
+static long ms_until(const struct timespec *deadline)
 {
-    int i;
+    struct timespec now;
+    long long ns;
 
-    memset(board, 0, sizeof (board));
-    memset(board[0], ~0, sizeof (*board));
-    memset(board[GAME_BOARD_HEIGHT + 1], ~0, sizeof (*board));
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ns = (long long)(deadline->tv_sec - now.tv_sec) * 1000000000 +
+        (deadline->tv_nsec - now.tv_nsec);
 
-    for (i = 0; i < GAME_BOARD_HEIGHT + 2; i++)
-        board[i][0] = board[i][GAME_BOARD_WIDTH + 1] = ~0;
+    return ns > 0 ? (long)((ns + 999999) / 1000000) : 0;
 }
 
+/* the next gravity deadline, one interval after the last one */
+static void next_deadline(struct timespec *deadline, int timeout)
+{
+    add_ms(deadline, timeout);
+
+    /* if we were held up (animations, dialogs), don't try to catch up */
+    if (ms_until(deadline) <= 0) {
+        clock_gettime(CLOCK_MONOTONIC, deadline);
+        add_ms(deadline, timeout);
+    }
+}
 
-int initialize_game_elements(void)
+/* how long the game holds still for cleared rows */
+static int effects_duration(int events)
 {
-    /* initialize the board */
-    reset_game_board();
+    int ms = animation_duration(CLEAR_ANIMATION);
 
-    /* initialize the current and next block */
-    srand((unsigned) time(NULL));
-    next_block = (block_t)(rand() % TOTAL_BLOCKS);
-    next_block_orientation = (degree_t)(rand() % TOTAL_DEGREES);
+    if (events & GAME_EVENT_LEVEL_UP)
+        ms += animation_duration(ANIMATION_LEVEL_INFO);
+    return ms;
+}
 
-    return SUCCESS;
+/*
+ * Start off the effects of cleared rows; rows is the board to show once
+ * they're over, and locked_rows (if given) the board just before the clear.
+ */
+static void effects_start(struct clear_effects *effects, int events,
+        const int *cleared_rows, int count, const row_t *locked_rows,
+        const row_t *rows, const struct game_score *score)
+{
+    /* the full rows first, then animate them away */
+    if (locked_rows)
+        draw_board_rows(locked_rows);
+    animation_start(&effects->animation, CLEAR_ANIMATION, cleared_rows,
+            count, 0);
+    clock_gettime(CLOCK_MONOTONIC, &effects->start);
+
+    effects->active = 1;
+    effects->level_up = events & GAME_EVENT_LEVEL_UP;
+    effects->score = *score;
+    memcpy(effects->rows, rows, sizeof (effects->rows));
+}
+
+/* draw whatever is due, returns the ms till more is, or -1 once it's over */
+static long effects_update(struct clear_effects *effects)
+{
+    int wait;
+
+    if (!effects->active)
+        return -1;
+
+    wait = animation_update(&effects->animation,
+            (int)elapsed_ms(&effects->start));
+    if (wait >= 0)
+        return wait;
+
+    if (effects->animation.type != ANIMATION_LEVEL_INFO) {
+        draw_score_board(&effects->score);
+
+        if (effects->level_up) {
+            draw_board_rows(effects->rows);
+            animation_start(&effects->animation, ANIMATION_LEVEL_INFO, NULL,
+                    0, effects->score.level);
+            clock_gettime(CLOCK_MONOTONIC, &effects->start);
+            return animation_update(&effects->animation, 0);
+        }
+    }
+
+    draw_board_rows(effects->rows);
+    effects->active = 0;
+    clock_gettime(CLOCK_MONOTONIC, &effects->done);
+    return -1;
+}
+
+
+/* a frame was drawn with this many inputs applied since the last one */
+static void count_frame_inputs(int inputs)
+{
+    if (!inputs)
+        return;
+
+    input_stats.frames++;
+    input_stats.inputs += inputs;
+    if (inputs > input_stats.max)
+        input_stats.max = inputs;
+}
+
+#ifdef TETRIZ_LATENCY
+static void note_input_read(struct input_event *event,
+        const struct timespec *arrival)
+{
+    event->read = *arrival;
 }
 
+/* called right before data->inputs counts it */
+static void note_input_applied(struct thread_data *data,
+        const struct input_event *event)
+{
+    data->read[data->inputs % LATENCY_INPUTS] = event->read;
+}
 
-static inline struct block *update_current_block(struct block *block)
+/* the inputs counted from first up to last are on the screen now */
+static void note_inputs_shown(struct thread_data *data, uint64_t first,
+        uint64_t last)
 {
-    if (block == NULL)
-        block = &current_block;
+    struct timespec now;
 
-    block->color = 1;			/* not used currently */
-    block->type = next_block;
-    block->orientation = next_block_orientation;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    for (; first < last; first++)
+        histogram_record(&input_latency,
+                us_between(&data->read[first % LATENCY_INPUTS], &now));
+}
+
+/*
+ * A gravity tick is applied now, that was due at the deadline, or once the
+ * game was no longer held still, if that came later.
+ */
+static void note_tick(const struct timespec *deadline,
+        const struct timespec *held)
+{
+    struct timespec now;
+    uint64_t late, held_late;
 
-    next_block = (block_t)(rand() % TOTAL_BLOCKS);
-    next_block_orientation = (degree_t)(rand() % TOTAL_DEGREES);
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    late = us_between(deadline, &now);
+    held_late = us_between(held, &now);
+    histogram_record(&tick_lateness, late < held_late ? late : held_late);
+}
+#else
+#define note_input_read(event, arrival)         ((void)(arrival))
+#define note_input_applied(data, event)         ((void)0)
+#define note_inputs_shown(data, first, last)    ((void)(first), (void)(last))
+#define note_tick(deadline, held)               ((void)0)
+#endif
+
+/* note down an event fed to the engine */
+static void record_event(struct thread_data *data, int event, uint64_t time_ms)
+{
+    if (!data->replay)
+        return;
 
-    return block;
+    if (replay_record(data->replay, time_ms, event)) {
+        record_failed = 1;
+        replay_free(data->replay);
+        data->replay = NULL;
+    }
 }
 
+
 int start_new_game(void)
 {
-    struct thread_data data = { NULL, 0, 0, PTHREAD_MUTEX_INITIALIZER, 0, 0 };
+    struct replay replay;
+    struct game_state game;
+    struct thread_data data;
+    uint64_t seed = (uint64_t)time(NULL);
+
+    memset(&data, 0, sizeof (data));
+    data.game = &game;
+    if (raw_input)
+        keyboard_init(&data.keyboard, STDIN_FILENO);
+
+    game_init(&game, &game_options, global_highscore, seed);
+    if (record_path) {
+        replay_init(&replay, seed, &game_options);
+        data.replay = &replay;
+    }
 
-    initialize_game_elements();
     initialize_game_screen();
 
     /* draw the next block, and the begin game message */
-    draw_next_block(next_block, next_block_orientation);
+    draw_next_block(game.next_block, game.next_block_orientation);
     if (draw_start_game() == FAILURE)
         return SUCCESS;
 
     draw_level_info(game_options.initial_level);
+    clock_gettime(CLOCK_MONOTONIC, &data.start);
 
-    /* create the worker thread */
-    if (pthread_create(&data.thread_id, NULL, worker_thread_fn, (void *)&data))
+    if ((!event_loop || run_event_loop(&data) == FAILURE) &&
+            run_threads(&data) == FAILURE)
         return FAILURE;
 
-    /* the main thread for the core gameplay */
-    play_game(&data);
-    pthread_join(data.thread_id, NULL);
+    if (data.replay) {
+        replay_finish(data.replay, &game.score);
+        if (replay_save(data.replay, record_path))
+            record_failed = 1;
+        replay_free(data.replay);
+    }
 
     if (data.new_highscore)
         draw_highscore(global_highscore);
@@ -190,345 +348,676 @@ int start_new_game(void)
 }
 
 
-static void play_game(struct thread_data *data)
+/* let the block fall by one step, returns the engine's events */
+static int apply_gravity(struct thread_data *data, int *cleared_rows)
 {
-    int status;
-    input_t input;
-    int did_user_quit = 0;    /* 0 if game-over, otherwise if user quits */
+    int events;
 
-    while (1) {
-        /* take user input */
-        input = fetch_user_input();
-        if (input == INPUT_INVALID)
-            continue;
+    /* what the board looks like, in case rows get cleared */
+    game_render_rows(data->game, data->locked_rows);
 
-        pthread_mutex_lock(&data->lock);
+    record_event(data, REPLAY_EVENT_GRAVITY, elapsed_ms(&data->start));
+    events = game_gravity_tick(data->game, cleared_rows);
+    if (events & GAME_EVENT_GAME_OVER)
+        data->game_over = 1;
 
-        /* check if the game is still going on */
-        if (data->game_over) {
-            pthread_mutex_unlock(&data->lock);
-            break;
-        }
+    return events;
+}
 
-        /* in case there's no "current block", don't do anything */
-        if (input != INPUT_PAUSE_QUIT && 
-                (data->block_dropped_ignore_input || !data->current)) {
-            pthread_mutex_unlock(&data->lock);
-            continue;
-        }
+/*
+ * Feed a move to the engine, returns GAME_EVENT_MOVED if it worked, and 0
+ * otherwise. A hard drop locks the block right away (and the events of that
+ * are added in), so that it can't be moved any more once it's been dropped.
+ */
+static int apply_user_input(struct thread_data *data,
+        const struct input_event *event, int *cleared_rows)
+{
+    if (!game_current_block(data->game))
+        return 0;
 
-        /* take appropriate action based on user input */
-        switch (input) {
-            case INPUT_MOVE_LEFT:
-                status = move_block(data->current, ACTION_MOVE_LEFT);
-                if (status == SUCCESS)
-                    draw_game_board(data->current);
-                break;
-            case INPUT_MOVE_RIGHT:
-                status = move_block(data->current, ACTION_MOVE_RIGHT);
-                if (status == SUCCESS)
-                    draw_game_board(data->current);
-                break;
-            case INPUT_MOVE_DOWN:
-                status = move_block(data->current, ACTION_MOVE_DOWN);
-                if (status == SUCCESS)
-                    draw_game_board(data->current);
-                break;
-            case INPUT_MOVE_UP_DROP:
-                status = move_block(data->current, ACTION_MOVE_UP_DROP);
-                if (status == SUCCESS) {
-                    data->block_dropped_ignore_input = 1;
-                    draw_game_board(data->current);
-                }
-                break;
-            case INPUT_ROTATE_LEFT:
-                status = move_block(data->current, ACTION_ROTATE_LEFT);
-                if (status == SUCCESS)
-                    draw_game_board(data->current);
-                break;
-            case INPUT_ROTATE_RIGHT:
-                status = move_block(data->current, ACTION_ROTATE_RIGHT);
-                if (status == SUCCESS)
-                    draw_game_board(data->current);
-                break;
-            case INPUT_PAUSE_QUIT:
-                status = display_quit_dialog();
-                draw_game_board(data->current);
-                if (status == FAILURE) {    /* if the user chooses to quit */
-                    data->game_over = 1;
-                    did_user_quit = 1;
-                }
-                break;
-            case INPUT_TIMEOUT:     /* nothing to do */
-                break;
-            default:
-                break;
-        }
+    record_event(data, event->input, event->time_ms);
+    if (game_apply_input(data->game, event->input) == FAILURE)
+        return 0;
+
+    if (event->input == INPUT_MOVE_UP_DROP)
+        return GAME_EVENT_MOVED | apply_gravity(data, cleared_rows);
+
+    return GAME_EVENT_MOVED;
+}
 
-        pthread_mutex_unlock(&data->lock);
+static void update_highscore(struct thread_data *data)
+{
+    if (data->game->score.score > global_highscore) {
+        global_highscore = data->game->score.score;
+        data->new_highscore = 1;
     }
+}
+
+
+/* wake up whoever waits on the eventfd */
+static void poke(int fd)
+{
+    uint64_t one = 1;
+    ssize_t ret = write(fd, &one, sizeof (one));
 
-    draw_gameover(did_user_quit);
+    (void)ret;      /* if the counter is saturated, it's awake anyway */
 }
 
+/* and take the pokes, once awake */
+static void drain(int fd)
+{
+    uint64_t count;
+    ssize_t ret = read(fd, &count, sizeof (count));
+
+    (void)ret;      /* nothing to take, then */
+}
 
-static int move_block(struct block *block, action_t movement)
+static int run_threads(struct thread_data *data)
 {
-    int result;
-    struct block newblock = *block;	/* start with a copy of the given block */
+    int status = FAILURE;
+
+    input_queue_init(&data->queue);
+    snapshot_buffer_init(&data->snapshots);
+
+    data->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    data->render_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (data->wake_fd < 0 || data->render_fd < 0)
+        goto out;
+
+    sem_init(&data->paused, 0, 0);
+    sem_init(&data->resumed, 0, 0);
+    pthread_mutex_init(&data->screen, NULL);
+
+    /* create the render thread, then the game thread */
+    if (pthread_create(&data->render_thread_id, NULL, render_thread_fn,
+                (void *)data) == 0) {
+        if (pthread_create(&data->thread_id, NULL, worker_thread_fn,
+                    (void *)data) == 0) {
+            /* and read the keyboard on this one */
+            play_game(data);
+            stats_thread_done("reader");
+            pthread_join(data->thread_id, NULL);
+            status = SUCCESS;
+        }
 
-    /* apply the requested operation */
-    switch (movement) {
-        case ACTION_MOVE_LEFT:
-            --newblock.origin.x;
-            assert(newblock.origin.x < GAME_BOARD_WIDTH);
-            break;
-        case ACTION_MOVE_RIGHT:
-            ++newblock.origin.x;
-            assert(newblock.origin.x < GAME_BOARD_WIDTH);
-            break;
-        case ACTION_MOVE_DOWN:
-            ++newblock.origin.y;
-            assert(newblock.origin.y < GAME_BOARD_HEIGHT);
-            break;
-        case ACTION_MOVE_UP_DROP:
-            /* FIXME: not an optimal solution */
-            do {
-                newblock.origin.y++;
-            } while (test_movement(&newblock) == SUCCESS);
-
-            newblock.origin.y--;
-            assert(newblock.origin.y < GAME_BOARD_HEIGHT);
-            break;
-        case ACTION_ROTATE_LEFT:
-            if (newblock.orientation == DEG_0)
-                newblock.orientation = TOTAL_DEGREES - 1;
-            else
-                --newblock.orientation;
-            newblock.position = &positions[newblock.type][newblock.orientation];
-            break;
-        case ACTION_ROTATE_RIGHT:
-            newblock.orientation = (newblock.orientation + 1) % TOTAL_DEGREES;
-            newblock.position = &positions[newblock.type][newblock.orientation];
-            break;
-        case ACTION_PLACE_NEW:
-            newblock.origin = starting_position;
-            newblock.position = &positions[newblock.type][newblock.orientation];
-            break;			/* no change in position requested */
+        data->render_stop = 1;
+        poke(data->render_fd);
+        pthread_join(data->render_thread_id, NULL);
 
-        default:
-            return FAILURE;
+        if (status == SUCCESS)
+            draw_gameover(data->user_quit);
     }
 
-    /* check if the new changes can be applied */
-    result = test_movement(&newblock);
+    pthread_mutex_destroy(&data->screen);
+    sem_destroy(&data->resumed);
+    sem_destroy(&data->paused);
 
-    if (result == SUCCESS)
-        *block = newblock;		/* apply the new change */
+out:
+    if (data->render_fd >= 0)
+        close(data->render_fd);
+    if (data->wake_fd >= 0)
+        close(data->wake_fd);
 
-    return result;
+    return status;
 }
 
-static int test_movement(struct block *block)
+/* all the keys that have come in, waiting a while for the first one */
+static int read_inputs(struct thread_data *data, input_t *inputs, int max,
+        struct timespec *arrival)
 {
-    int i;
-    int status = SUCCESS;
+    int count;
 
-    for (i = 0; i < ARRAY_LEN(block->position->pos); i++) {
-        int x = block->origin.x + block->position->pos[i].x;
-        int y = block->origin.y + block->position->pos[i].y;
+    if (!raw_input) {
+        count = fetch_user_inputs(inputs, max);
+        clock_gettime(CLOCK_MONOTONIC, arrival);
+        return count;
+    }
 
-        if (board[y + 1][x + 1]) {
-            status = FAILURE;
-            break;
+    count = keyboard_read(&data->keyboard, inputs, max, READ_TIMEOUT,
+            arrival);
+    return count > 0 ? count : 0;
+}
+
+static void play_game(struct thread_data *data)
+{
+    int i, count;
+    int paused;
+    input_t inputs[INPUT_BATCH];
+    struct input_event event;
+    struct timespec arrival;
+
+    while (!data->game_over) {
+        /* take all the user input there is, and wake the game just once */
+        count = read_inputs(data, inputs, ARRAY_LEN(inputs), &arrival);
+        if (!count)
+            continue;
+        event.time_ms = ms_between(&data->start, &arrival);
+        note_input_read(&event, &arrival);
+
+        /*
+         * if the game is that far behind, the keys are lost; and so are the
+         * ones after a pause (curses leaves those to the dialog)
+         */
+        for (i = 0, paused = 0; i < count && !paused; i++) {
+            event.input = inputs[i];
+            if (input_queue_push(&data->queue, &event) == FAILURE)
+                break;
+            paused = event.input == INPUT_PAUSE_QUIT;
         }
-    }
+        if (i == 0)
+            continue;
+        poke(data->wake_fd);
 
-    return status;
+        if (paused) {
+            /* the dialog needs the screen, wait for the game to stop */
+            sem_wait(&data->paused);
+            if (data->game_over)
+                break;
+
+            stats_lock(&data->screen);
+            data->user_quit = display_quit_dialog() == FAILURE;
+            stats_unlock(&data->screen);
+            sem_post(&data->resumed);
+        }
+    }
 }
 
-static void *worker_thread_fn(void *arg)
+
+/* hand the screen to the reader for the quit dialog, until it's done */
+static void pause_game(struct thread_data *data, struct timespec *deadline)
 {
-    int i;
-    int status;
-    int timeout = INITIAL_TIMEOUT;
-    struct game_score game_score = { game_options.initial_level, 
-        0, 0, 0, global_highscore };
-    struct thread_data *data = (struct thread_data *)arg;
+    sem_post(&data->paused);
+    sem_wait(&data->resumed);
 
-    /* setup the initial timeout (by reducing all deltas upto initial_level */
-    for (i = 1; i <= game_options.initial_level; i++)
-        timeout -= TIMEOUT_DELTA(i);
+    if (data->user_quit) {
+        data->game_over = 1;
+        return;
+    }
 
-    draw_score_board(&game_score);
+    /* the game was paused, give the player a full interval */
+    clock_gettime(CLOCK_MONOTONIC, deadline);
+    add_ms(deadline, data->game->timeout);
+}
 
-    /* main game loop */
-    while (1) {
-        /* wait till timeout */
-        snooze(timeout);
+/* hand the game as it is now over to the render thread */
+static void publish_snapshot(struct thread_data *data, int events,
+        const int *cleared_rows)
+{
+    const struct game_state *game = data->game;
+    struct game_snapshot *snapshot = snapshot_slot(&data->snapshots);
+
+    game_render_rows(game, snapshot->rows);
+    snapshot->next_block = game->next_block;
+    snapshot->next_block_orientation = game->next_block_orientation;
+    snapshot->score = game->score;
+    snapshot->inputs = data->inputs;
+    snapshot->events = events;
+    snapshot->cleared_count = 0;
+
+    if (events & GAME_EVENT_ROWS_CLEARED) {
+        memcpy(snapshot->locked_rows, data->locked_rows,
+                sizeof (snapshot->locked_rows));
+        memcpy(snapshot->cleared_rows, cleared_rows,
+                game->cleared_count * sizeof (*cleared_rows));
+        snapshot->cleared_count = game->cleared_count;
+    }
 
-        /* acquire the lock */
-        pthread_mutex_lock(&data->lock);
+    snapshot_publish(&data->snapshots);
+    poke(data->render_fd);
+}
 
-        if (data->game_over) {
-            pthread_mutex_unlock(&data->lock);
-            break;
-        }
+static void *worker_thread_fn(void *arg)
+{
+    int events;
+    int holding = 0;
+    long timeout;
+    uint64_t start;
+    struct timespec deadline, resume;
+    struct input_event event;
+    int cleared_rows[GAME_BOARD_HEIGHT];
+    struct thread_data *data = (struct thread_data *)arg;
+    struct game_state *game = data->game;
+    struct pollfd wake = { data->wake_fd, POLLIN, 0 };
 
-        if (!data->current) {
-            data->current = update_current_block(NULL);
+    publish_snapshot(data, 0, NULL);
+    deadline = resume = data->start;
+    add_ms(&deadline, game->timeout);
 
-            status = move_block(data->current, ACTION_PLACE_NEW);
-            if (status == FAILURE) {
-                data->game_over = 1;
-                pthread_mutex_unlock(&data->lock);
-                break;
+    /* main game loop */
+    while (!data->game_over) {
+        /* wait till the next gravity step, or till there's input */
+        timeout = ms_until(holding ? &resume : &deadline);
+        if (timeout != 0 && poll(&wake, 1, (int)timeout) > 0)
+            drain(data->wake_fd);
+
+        /* cleared rows hold everything still while they're shown */
+        if (holding && ms_until(&resume) > 0)
+            continue;
+        holding = 0;
+
+        /* apply everything that was queued up, in order */
+        start = phase_begin();
+        events = 0;
+        while (!data->game_over && !(events & GAME_EVENT_ROWS_CLEARED) &&
+                input_queue_pop(&data->queue, &event) == SUCCESS) {
+            if (event.input == INPUT_PAUSE_QUIT) {
+                phase_end(PHASE_LOGIC, start);
+                pause_game(data, &deadline);
+                start = phase_begin();
+                events |= GAME_EVENT_MOVED;     /* to redraw the board */
+            } else {
+                events |= apply_user_input(data, &event, cleared_rows);
+                note_input_applied(data, &event);
+                data->inputs++;
             }
+        }
 
-            draw_next_block(next_block, next_block_orientation);
-        } else {
-            /* try moving the block downwards */
-            status = move_block(data->current, ACTION_MOVE_DOWN);
-            if (status == FAILURE) {
-                int ret, num_rows;
-
-                /* freeze this block in the game board */
-                freeze_block(data->current);
-                data->current = NULL;	/* reset the current block pointer */
-                data->block_dropped_ignore_input = 0; /* reset this now */
-
-                num_rows = clear_even_rows();
-                if (num_rows) {
-                    ret = update_score_level(&game_score, num_rows, &timeout);
-                    draw_score_board(&game_score);
-
-                    /* see if the level has changed */
-                    if (ret) {
-                        draw_game_board(data->current);
-                        draw_level_info(game_score.level);
-                    }
-                }
-            }
+        if (!data->game_over && !(events & GAME_EVENT_ROWS_CLEARED) &&
+                ms_until(&deadline) <= 0) {
+            note_tick(&deadline, &resume);
+            events |= apply_gravity(data, cleared_rows);
+            next_deadline(&deadline, game->timeout);
         }
 
-        draw_game_board(data->current);
-        pthread_mutex_unlock(&data->lock);
-    }
+        /* one snapshot for all of it */
+        if (events && !data->game_over)
+            publish_snapshot(data, events, cleared_rows);
+        phase_end(PHASE_LOGIC, start);
 
-    if (game_score.score > global_highscore) {
-        global_highscore = game_score.score;
-        data->new_highscore = 1;
+        /* and hold still for as long as the renderer animates them */
+        if (events & GAME_EVENT_ROWS_CLEARED && !data->game_over) {
+            clock_gettime(CLOCK_MONOTONIC, &resume);
+            add_ms(&resume, effects_duration(events));
+            holding = 1;
+        }
     }
 
+    /* in case the reader is waiting for us to pause */
+    sem_post(&data->paused);
+
+    update_highscore(data);
+    stats_thread_done("game");
     return arg;
 }
 
 
-static int update_score_level(struct game_score *score, int num_rows, 
-        int *timeout)
+/* bring the screen up to date with a snapshot */
+static void draw_snapshot(const struct game_snapshot *snapshot,
+        struct game_snapshot *drawn, struct clear_effects *effects)
 {
-    int has_level_changed = 0;
+    struct game_score score = snapshot->score;
+
+    if (snapshot->next_block != drawn->next_block ||
+            snapshot->next_block_orientation !=
+            drawn->next_block_orientation) {
+        draw_next_block(snapshot->next_block,
+                snapshot->next_block_orientation);
+    }
 
-    //score->score += (score->level + SCORE_CLEAR_ROW) * num_rows * num_rows;
-    score->score += score->level * num_rows * num_rows * BASE_SCORE_PER_ROW;
-    if (score->score > score->current_highscore)
-        score->current_highscore = score->score;
+    if (snapshot->events & GAME_EVENT_ROWS_CLEARED) {
+        /* the rest of it is drawn frame by frame, see render_thread_fn */
+        effects_start(effects, snapshot->events, snapshot->cleared_rows,
+                snapshot->cleared_count, snapshot->locked_rows,
+                snapshot->rows, &score);
+    } else {
+        if (memcmp(&score, &drawn->score, sizeof (score)))
+            draw_score_board(&score);
+        draw_board_rows(snapshot->rows);
+    }
+
+    *drawn = *snapshot;
+}
 
-    score->total_rows += num_rows;
-    score->rows_cleared += num_rows;
+static void *render_thread_fn(void *arg)
+{
+    long wait;
+    uint64_t shown, start;
+    struct timespec next_frame;
+    struct game_snapshot drawn;
+    struct clear_effects effects;
+    const struct game_snapshot *snapshot;
+    struct thread_data *data = (struct thread_data *)arg;
+    struct pollfd wake = { data->render_fd, POLLIN, 0 };
+
+    /* nothing's been drawn yet, so make sure everything will be */
+    memset(&drawn, 0, sizeof (drawn));
+    drawn.next_block = TOTAL_BLOCKS;
+    drawn.score.level = -1;
+    effects.active = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &next_frame);
+
+    while (!data->render_stop) {
+        /* cleared rows keep the screen till they're done, newer or not */
+        if (effects.active) {
+            stats_lock(&data->screen);
+            start = phase_begin();
+            wait = effects_update(&effects);
+            render_frame();
+            phase_end(PHASE_ANIMATION, start);
+            stats_unlock(&data->screen);
+
+            if (wait >= 0) {
+                if (poll(&wake, 1, (int)wait) > 0)
+                    drain(data->render_fd);
+                continue;
+            }
+        }
 
-    if (score->rows_cleared >= MAX_ROWS_PER_LEVEL) {
-        if (game_options.increase_difficulty &&
-                score->level < DIFFICULTY_LEVEL_MAX)
-            *timeout -= TIMEOUT_DELTA(score->level);
+        /* whatever comes in till the next frame is due is skipped */
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_frame, NULL);
 
-        if (game_options.clear_on_new_level)
-            reset_game_board();
+        snapshot = snapshot_take(&data->snapshots);
+        if (!snapshot) {
+            if (poll(&wake, 1, -1) > 0)
+                drain(data->render_fd);
+            continue;
+        }
 
-        score->level++;
-        score->rows_cleared = 0;
-        has_level_changed = 1;
+        count_frame_inputs((int)(snapshot->inputs - drawn.inputs));
+        shown = drawn.inputs;
+
+        stats_lock(&data->screen);
+        start = phase_begin();
+        draw_snapshot(snapshot, &drawn, &effects);
+        render_frame();
+        phase_end(PHASE_RENDER, start);
+        stats_unlock(&data->screen);
+        note_inputs_shown(data, shown, drawn.inputs);
+
+        clock_gettime(CLOCK_MONOTONIC, &next_frame);
+        next_frame.tv_nsec += 1000000000 / RENDER_FPS;
+        if (next_frame.tv_nsec >= 1000000000) {
+            next_frame.tv_sec++;
+            next_frame.tv_nsec -= 1000000000;
+        }
     }
 
-    return has_level_changed;
+    stats_thread_done("render");
+    return arg;
 }
 
 
-/* the nearest empty row (counting from bottom) in the board */
-static int top_row = GAME_BOARD_HEIGHT;
+/*
+ * The next input there is, for the event loop: from curses, or from what
+ * was last read off the terminal with raw_input. FAILURE if there's none.
+ */
+static int next_input(struct thread_data *data, struct input_event *event)
+{
+    struct timespec arrival;
+    struct key_batch *keys = &data->keys;
+
+    if (!raw_input) {
+        event->input = fetch_user_input_nowait();
+        clock_gettime(CLOCK_MONOTONIC, &arrival);
+        event->time_ms = ms_between(&data->start, &arrival);
+        note_input_read(event, &arrival);
+        return event->input == INPUT_TIMEOUT ? FAILURE : SUCCESS;
+    }
+
+    if (keys->next == keys->count) {
+        keys->count = keyboard_read(&data->keyboard, keys->inputs,
+                ARRAY_LEN(keys->inputs), 0, &keys->arrival);
+        keys->next = 0;
+        if (keys->count <= 0) {
+            keys->count = 0;
+            return FAILURE;
+        }
+    }
+
+    event->input = keys->inputs[keys->next++];
+    event->time_ms = ms_between(&data->start, &keys->arrival);
+    note_input_read(event, &keys->arrival);
+    return SUCCESS;
+}
 
-static void freeze_block(struct block *current)
+static void arm_timer(int timer_fd, const struct timespec *deadline)
 {
-    int i;
-    static const int empty_row[GAME_BOARD_WIDTH + 2] = {
-        ~0,
-        0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,     /* GAME_BOARD_WIDTH times */
-        ~0,
-    };
+    struct itimerspec timer = { { 0, 0 }, *deadline };
 
-    /* fuse the current block with the board */
-    for (i = 0; i < ARRAY_LEN(current->position->pos); i++) {
-        int x = current->origin.x + current->position->pos[i].x;
-        int y = current->origin.y + current->position->pos[i].y;
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &timer, NULL);
+}
 
-        assert(board[y + 1][x + 1] == 0);
-        board[y + 1][x + 1] = current->color;
-    }
+/*
+ * The single threaded game loop: one thread waits on both the terminal and a
+ * timer armed with absolute deadlines, so gravity keeps its exact pace and
+ * input is handled the moment it arrives, with nothing to hand over.
+ * Returns FAILURE (before the game starts) if there's no timer to be had.
+ */
+static int run_event_loop(struct thread_data *data)
+{
+    int events;
+    int inputs;
+    int animating;
+    int timer_fd;
+    long timeout;
+    uint64_t start;
+    uint64_t shown = 0;
+    uint64_t expirations;
+    struct timespec deadline;
+    struct input_event event;
+    struct pollfd fds[2];
+    struct clear_effects effects;
+    int cleared_rows[GAME_BOARD_HEIGHT];
+    struct game_state *game = data->game;
+
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (timer_fd < 0)
+        return FAILURE;
 
-    /* now recompute the top_row */
-    for (i = GAME_BOARD_HEIGHT; i > 0; i--) {
-        if (memcmp((void *)board[i], (void *)empty_row, sizeof (*board)) == 0) {
-            top_row = i;
+    fds[0].fd = STDIN_FILENO;
+    fds[1].fd = timer_fd;
+    effects.active = 0;
+    effects.done = data->start;
+
+    draw_score_board(&game->score);
+    deadline = data->start;
+    next_deadline(&deadline, game->timeout);
+    arm_timer(timer_fd, &deadline);
+
+    while (!data->game_over) {
+        /* while cleared rows are shown, keys and the timer wait */
+        start = phase_begin();
+        animating = effects.active;
+        timeout = effects_update(&effects);
+        render_frame();
+        phase_end(animating ? PHASE_ANIMATION : PHASE_RENDER, start);
+        note_inputs_shown(data, shown, data->inputs);
+        shown = data->inputs;
+        fds[0].events = fds[1].events = effects.active ? 0 : POLLIN;
+
+        if (poll(fds, ARRAY_LEN(fds), (int)timeout) < 0) {
+            if (errno == EINTR)
+                continue;
             break;
         }
+
+        if (effects.active)
+            continue;
+
+        /*
+         * everything that was typed, in order, and then draw once; curses
+         * (or a key batch) may hold keys stdin doesn't show any more, so
+         * always ask
+         */
+        start = phase_begin();
+        events = inputs = 0;
+        while (!data->game_over && !(events & GAME_EVENT_ROWS_CLEARED) &&
+                next_input(data, &event) == SUCCESS) {
+            if (event.input == INPUT_PAUSE_QUIT) {
+                phase_end(PHASE_LOGIC, start);
+                data->user_quit = display_quit_dialog() == FAILURE;
+                data->game_over = data->user_quit;
+                draw_game_board(game);
+
+                /* the game was paused, give the player a full interval */
+                clock_gettime(CLOCK_MONOTONIC, &deadline);
+                add_ms(&deadline, game->timeout);
+                arm_timer(timer_fd, &deadline);
+                start = phase_begin();
+            } else if (event.input != INPUT_INVALID) {
+                events |= apply_user_input(data, &event, cleared_rows);
+                note_input_applied(data, &event);
+                data->inputs++;
+                inputs++;
+            }
+        }
+        count_frame_inputs(inputs);
+        phase_end(PHASE_LOGIC, start);
+
+        if (events && !data->game_over) {
+            start = phase_begin();
+            draw_tick_events(game, events, cleared_rows, data->locked_rows,
+                    &effects);
+            phase_end(PHASE_RENDER, start);
+        }
+
+        if (!data->game_over && !effects.active &&
+                (fds[1].revents & POLLIN) &&
+                read(timer_fd, &expirations, sizeof (expirations)) > 0) {
+            note_tick(&deadline, &effects.done);
+            start = phase_begin();
+            events = apply_gravity(data, cleared_rows);
+            phase_end(PHASE_LOGIC, start);
+            if (!data->game_over) {
+                start = phase_begin();
+                draw_tick_events(game, events, cleared_rows,
+                        data->locked_rows, &effects);
+                phase_end(PHASE_RENDER, start);
+            }
+            next_deadline(&deadline, game->timeout);
+            arm_timer(timer_fd, &deadline);
+        }
     }
 
-    assert(top_row > 0);
+    close(timer_fd);
+    update_highscore(data);
+    stats_thread_done("loop");
+    draw_gameover(data->user_quit);
+
+    return SUCCESS;
 }
 
 
-static int clear_even_rows(void)
+/*
+ * Bring the screen up to date after a gravity tick. Cleared rows are only
+ * set off here, for the caller to step through with effects_update().
+ */
+static void draw_tick_events(struct game_state *game, int events,
+        const int *cleared_rows, const row_t *locked_rows,
+        struct clear_effects *effects)
 {
-    int abs_row;                /* absolute row number */
-    int count = 0;
-    int i = GAME_BOARD_HEIGHT;
-    int cleared_rows[4];        /* XXX: max 4 rows can be cleared at a time? */
+    row_t rows[GAME_BOARD_HEIGHT];
 
-    /* use animation style 3 */
-    static void (*clear_animation)(int *, int) = draw_cleared_rows_animation_3;
+    if (events & GAME_EVENT_SPAWNED)
+        draw_next_block(game->next_block, game->next_block_orientation);
 
-    for (abs_row = GAME_BOARD_HEIGHT; i > top_row; abs_row--) {
-        int j;
-        int found = 1;
+    if (events & GAME_EVENT_ROWS_CLEARED) {
+        /* the board might not have been drawn since the block was locked */
+        game_render_rows(game, rows);
+        effects_start(effects, events, cleared_rows, game->cleared_count,
+                locked_rows, rows, &game->score);
+        return;
+    }
 
-        for (j = 1; j < GAME_BOARD_WIDTH + 1; j++) {
-            if (!board[i][j]) {
-                found = 0;
-                break;
-            }
-        }
+    draw_game_board(game);
+}
+
+
+/* as fast as the engine goes, with no rendering (and no terminal) at all */
+static int run_replay_headless(const struct replay *replay)
+{
+    int status;
+    long events;
+    double seconds;
+    struct game_state game;
+    struct timespec start, end;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    game_init(&game, &replay->options, 0, replay->seed);
+    status = replay_run(replay->events, replay->length, &game, &events);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    stats_thread_done("replay");
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    if (game.score.score != replay->final_score.score ||
+            game.score.total_rows != replay->final_score.total_rows ||
+            game.score.level != replay->final_score.level)
+        status = FAILURE;
+
+    printf("seed %llu: level %d, %d rows, score %d (recorded %d) - %s\n",
+            (unsigned long long)replay->seed, game.score.level,
+            game.score.total_rows, game.score.score,
+            replay->final_score.score, status ? "MISMATCH" : "ok");
+    printf("%ld events in %.3f ms (%.0f events/sec)\n", events,
+            seconds * 1000, seconds > 0 ? events / seconds : 0.0);
+
+    return status;
+}
 
-        if (found)
-            cleared_rows[count++] = abs_row - 1;  /* save the absolute row */
-        else {
-            i--;
-            continue;		                /* move on to check the next row */
+/* at the recorded speed, drawing everything just like the game did */
+static int run_replay_realtime(const struct replay *replay)
+{
+    int event, events;
+    long wait;
+    int cleared_rows[GAME_BOARD_HEIGHT];
+    struct game_state game;
+    struct timespec start;
+    struct replay_cursor cursor;
+    struct clear_effects effects;
+
+    game_init(&game, &replay->options, global_highscore, replay->seed);
+    initialize_game_screen();
+    draw_next_block(game.next_block, game.next_block_orientation);
+    draw_score_board(&game.score);
+
+    effects.active = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    replay_cursor_init(&cursor, replay->events, replay->length);
+
+    while (replay_next(&cursor, &event) == SUCCESS) {
+        uint64_t now = elapsed_ms(&start);
+
+        if (cursor.time_ms > now)
+            snooze((int)(cursor.time_ms - now));
+
+        events = replay_apply(&game, event, cleared_rows);
+        if (event == REPLAY_EVENT_GRAVITY)
+            draw_tick_events(&game, events, cleared_rows, NULL, &effects);
+        else
+            draw_game_board(&game);
+        render_frame();
+
+        /* the game held still meanwhile, so there's nothing else to do */
+        while ((wait = effects_update(&effects)) >= 0) {
+            render_frame();
+            snooze((int)wait);
         }
+        render_frame();
+    }
+
+    draw_gameover(0);
+    return SUCCESS;
+}
 
-        memset(board[i], 0, sizeof (*board));   /* clear the current row */
-        /* move down the all the rows above the cleared row */
-        memmove((void *)board[top_row + 1], (void *)board[top_row], 
-                (i - top_row) * sizeof (*board));
+int play_replay(const char *path, int fast)
+{
+    int status;
+    struct replay replay;
 
-        top_row++;
-        assert(top_row <= GAME_BOARD_HEIGHT);
+    if (replay_load(&replay, path)) {
+        fprintf(stderr, "%s: failed to load the replay '%s'\n",
+                prog_name, path);
+        return FAILURE;
     }
 
-    /* now animate (blink) the cleared rows */
-    if (count)
-        clear_animation(cleared_rows, count);
+    if (fast)
+        status = run_replay_headless(&replay);
+    else
+        status = run_replay_realtime(&replay);
 
-    return count;
+    replay_free(&replay);
+    return status;
 }
 
 /* vim: set ai ts=4 sw=4 tw=80 expandtab: */
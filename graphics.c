@@ -1,11 +1,9 @@
 #include "tetriz.h"
+#include "render.h"
 #include <ncurses.h>
 
-#define PRINT_BLOCK(window, pos_y, pos_x)                           \
-    do {                                                            \
-        mvwaddch((window), (pos_y), ((pos_x) << 1), ACS_CKBOARD);   \
-        waddch((window), ACS_CKBOARD);                              \
-    } while (0)
+#include <stdio.h>
+#include <string.h>
 
 #define GAME_INPUT_TIMEOUT      1000    /* getch() timeout during gameplay */
 
@@ -17,6 +15,174 @@ static WINDOW *win_score = NULL;
 static WINDOW *win_menu = NULL;
 static WINDOW *win_options = NULL;
 
+/*
+ * What draw_game_board() last left on a board window, one bit per cell as
+ * in the engine's rows, so that only the cells that changed get redrawn.
+ * Whatever else draws over the board marks the frame as not valid, and the
+ * next one is then drawn in full.
+ */
+struct board_view {
+    area_t area;
+    int valid;
+    row_t rows[GAME_BOARD_HEIGHT];
+};
+
+static struct board_view game_view = { AREA_GAME, 0, { 0 } };
+
+static void hand_over_to_curses(void);
+
+/* the rest of what the game screen shows, for hand_over_to_curses() */
+static struct {
+    int has_next_block;
+    block_t next_block;
+    degree_t next_block_orientation;
+    int has_score;
+    struct game_score score;
+} shown;
+
+static const char *blank_row = "                        ";
+
+/* the ncurses backend draws on the windows, and updates them all at once */
+static WINDOW **area_windows[RENDER_AREAS] = {
+    [AREA_GAME] = &win_game,
+    [AREA_NEXT] = &win_next,
+    [AREA_SCORE] = &win_score,
+};
+
+static void curses_start(const struct render_area *areas)
+{
+    (void)areas;
+}
+
+static void curses_blank(area_t area)
+{
+    werase(*area_windows[area]);
+}
+
+static void curses_blocks(area_t area, int y, int x, int count)
+{
+    mvwhline(*area_windows[area], y, x << 1, ACS_CKBOARD, count << 1);
+}
+
+static void curses_text(area_t area, int y, int x, int reverse,
+        const char *text)
+{
+    WINDOW *window = *area_windows[area];
+
+    if (reverse)
+        wattron(window, A_REVERSE | A_BOLD);
+    mvwaddstr(window, y, x, text);
+    if (reverse)
+        wattroff(window, A_REVERSE | A_BOLD);
+}
+
+static void curses_frame(void)
+{
+    int i;
+
+    for (i = 0; i < RENDER_AREAS; i++)
+        wnoutrefresh(*area_windows[i]);
+    doupdate();
+}
+
+static void curses_stop(void)
+{
+}
+
+static const struct render_backend curses_backend = {
+    "ncurses", curses_start, curses_blank, curses_blocks, curses_text,
+    curses_frame, curses_stop,
+};
+
+/* the null backend, for when nobody is watching */
+static void null_start(const struct render_area *areas)
+{
+    (void)areas;
+}
+
+static void null_blank(area_t area)
+{
+    (void)area;
+}
+
+static void null_blocks(area_t area, int y, int x, int count)
+{
+    (void)area, (void)y, (void)x, (void)count;
+}
+
+static void null_text(area_t area, int y, int x, int reverse,
+        const char *text)
+{
+    (void)area, (void)y, (void)x, (void)reverse, (void)text;
+}
+
+static void null_frame(void)
+{
+}
+
+static const struct render_backend null_backend = {
+    "null", null_start, null_blank, null_blocks, null_text, null_frame,
+    null_frame,
+};
+
+static const struct render_backend *backends[] = {
+    &curses_backend, &ansi_backend, &null_backend,
+};
+
+static const struct render_backend *render = &curses_backend;
+static int frame_pending = 0;           /* anything put since the last frame */
+
+struct render_stats render_stats;
+
+/* pick the backend by name (--render), FAILURE if there's no such one */
+int select_renderer(const char *name)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_LEN(backends); i++) {
+        if (!strcmp(backends[i]->name, name)) {
+            render = backends[i];
+            return SUCCESS;
+        }
+    }
+
+    return FAILURE;
+}
+
+const char *renderer_name(void)
+{
+    return render->name;
+}
+
+static void blank_area(area_t area)
+{
+    render->blank(area);
+    frame_pending = 1;
+}
+
+static void put_blocks(area_t area, int y, int x, int count)
+{
+    render->blocks(area, y, x, count);
+    frame_pending = 1;
+}
+
+static void put_text(area_t area, int y, int x, int reverse, const char *text)
+{
+    render->text(area, y, x, reverse, text);
+    frame_pending = 1;
+}
+
+/* show the game screen as drawn so far, once a frame */
+void render_frame(void)
+{
+    if (!frame_pending)
+        return;
+
+    render->frame();
+    render_stats.frames++;
+    frame_pending = 0;
+}
+
 //static void fill_window(WINDOW *win);
 
 int snooze(int ms)
@@ -484,6 +650,13 @@ void display_set_options(void)
 
 void initialize_game_screen(void)
 {
+    int i;
+    struct render_area areas[RENDER_AREAS];
+
+    game_view.valid = 0;
+    memset(game_view.rows, 0, sizeof (game_view.rows));
+    memset(&shown, 0, sizeof (shown));
+
     werase(win_main);
     wborder(win_main, 0, 0, 0, 0, 0, 0, 0, 0);
 
@@ -524,13 +697,16 @@ void initialize_game_screen(void)
     mvwaddch(win_main, 23, 40, ACS_BTEE);
 
     wrefresh(win_main);
+
+    for (i = 0; i < RENDER_AREAS; i++)
+        getbegyx(*area_windows[i], areas[i].y, areas[i].x);
+    render->start(areas);
 }
 
 
-input_t fetch_user_input(void)
+static input_t translate_input(int input)
 {
     input_t result;
-    int input = wgetch(win_game);
 
     switch (input) {
         case ERR:                               /* timeout */
@@ -565,6 +741,47 @@ input_t fetch_user_input(void)
     return result;
 }
 
+input_t fetch_user_input(void)
+{
+    return translate_input(wgetch(win_game));
+}
+
+/* like fetch_user_input(), but INPUT_TIMEOUT right away if nothing's there */
+input_t fetch_user_input_nowait(void)
+{
+    int input;
+
+    wtimeout(win_game, 0);
+    input = wgetch(win_game);
+    wtimeout(win_game, GAME_INPUT_TIMEOUT);
+
+    return translate_input(input);
+}
+
+/*
+ * Wait for input like fetch_user_input(), then take everything else that's
+ * already come in along with it, up to max inputs; returns how many there
+ * were (none on a timeout). A pause ends the batch, so that the keys after
+ * it are left for the quit dialog.
+ */
+int fetch_user_inputs(input_t *inputs, int max)
+{
+    int count = 0;
+    input_t input = fetch_user_input();
+
+    wtimeout(win_game, 0);
+    while (input != INPUT_TIMEOUT) {
+        if (input != INPUT_INVALID)
+            inputs[count++] = input;
+        if (count == max || input == INPUT_PAUSE_QUIT)
+            break;
+        input = translate_input(wgetch(win_game));
+    }
+    wtimeout(win_game, GAME_INPUT_TIMEOUT);
+
+    return count;
+}
+
 int display_quit_dialog(void)
 {
 #define MESSAGE_QUIT()                                  \
@@ -606,6 +823,8 @@ int display_quit_dialog(void)
                             "                        "
                             "                        ";
 
+    hand_over_to_curses();
+    game_view.valid = 0;            /* the dialog covers the board */
     wattron(win_quit, A_REVERSE | A_BOLD);
     mvwaddstr(win_quit, 0, 0, message);
     wattroff(win_quit, A_REVERSE | A_BOLD);
@@ -668,44 +887,133 @@ void draw_next_block(block_t type, degree_t orientation)
 {
     int i;
 
-    werase(win_next);
+    blank_area(AREA_NEXT);
     for (i = 0; i < ARRAY_LEN(positions[type][orientation].pos); i++) {
-        PRINT_BLOCK(win_next, 0 + positions[type][orientation].pos[i].y, 
-                0 + positions[type][orientation].pos[i].x);
+        put_blocks(AREA_NEXT, 0 + positions[type][orientation].pos[i].y,
+                0 + positions[type][orientation].pos[i].x, 1);
     }
-    wrefresh(win_next);
+
+    shown.has_next_block = 1;
+    shown.next_block = type;
+    shown.next_block_orientation = orientation;
 }
 
-void draw_game_board(struct block *block)
+static void draw_board_view(struct board_view *view, const row_t *rows)
 {
-    int i, j;
-
-    werase(win_game);
+    int i, x, count;
+    row_t changed, same;
 
-    for (i = 1; i < GAME_BOARD_HEIGHT + 1; i++) {
-        for (j = 1; j < GAME_BOARD_WIDTH + 1; j++) {
-            if (board[i][j])
-                PRINT_BLOCK(win_game, i-1, j-1);
-        }
+    if (!view->valid) {
+        blank_area(view->area);
+        memset(view->rows, 0, sizeof (view->rows));
+        view->valid = 1;
     }
 
-    if (block) {
-        for (i = 0; i < ARRAY_LEN(block->position->pos); i++) {
-            PRINT_BLOCK(win_game, block->origin.y + block->position->pos[i].y, 
-                    block->origin.x + block->position->pos[i].x);
+    /*
+     * a move touches 8 cells at most, and only those get drawn, a run of
+     * them that all turn the same way at a time
+     */
+    for (i = 0; i < GAME_BOARD_HEIGHT; i++) {
+        for (changed = rows[i] ^ view->rows[i]; changed;
+                changed &= ~(((1u << count) - 1) << (x + 1))) {
+            x = __builtin_ctz(changed) - 1;
+            same = (rows[i] & BOARD_CELL_BIT(x)) ? rows[i] : ~rows[i];
+            count = __builtin_ctz(~((changed & same) >> (x + 1)));
+
+            if (rows[i] & BOARD_CELL_BIT(x))
+                put_blocks(view->area, i, x, count);
+            else
+                put_text(view->area, i, x << 1, 0,
+                        blank_row + strlen(blank_row) - (count << 1));
         }
+        view->rows[i] = rows[i];
     }
+}
 
-    wrefresh(win_game);
+void draw_game_board(const struct game_state *game)
+{
+    row_t rows[GAME_BOARD_HEIGHT];
+
+    game_render_rows(game, rows);
+    draw_board_view(&game_view, rows);
+}
+
+/* the same, from rows as made by game_render_rows() */
+void draw_board_rows(const row_t *rows)
+{
+    draw_board_view(&game_view, rows);
+}
+
+/* the cleared rows animations all leave the rows blank */
+static void forget_view_rows(struct board_view *view, const int *rows,
+        int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+        view->rows[rows[i]] = 0;
 }
 
 
+/* only the lines that changed since it was last drawn get drawn again */
 void draw_score_board(struct game_score *score)
 {
-    mvwprintw(win_score, 0, 0, "%-8d\n%-8d%-8d%-8d\n%-8d", score->level, 
-            score->rows_cleared, score->total_rows, score->score, 
-            score->current_highscore);
-    wrefresh(win_score);
+    int i;
+    char line[16];
+    const struct game_score *old = &shown.score;
+    const struct {
+        int y;
+        int value;
+        int old;
+    } lines[] = {
+        { 0, score->level, old->level },
+        { 2, score->rows_cleared, old->rows_cleared },
+        { 3, score->total_rows, old->total_rows },
+        { 4, score->score, old->score },
+        { 6, score->current_highscore, old->current_highscore },
+    };
+
+    for (i = 0; i < ARRAY_LEN(lines); i++) {
+        if (shown.has_score && lines[i].value == lines[i].old)
+            continue;
+        snprintf(line, sizeof (line), "%-8d", lines[i].value);
+        put_text(AREA_SCORE, lines[i].y, 0, 0, line);
+    }
+
+    shown.has_score = 1;
+    shown.score = *score;
+}
+
+/*
+ * Before curses draws over the game screen itself, to wait for a key. With
+ * any other backend curses doesn't know what's on the screen, so give it the
+ * game as last shown and have the whole screen redrawn.
+ */
+static void hand_over_to_curses(void)
+{
+    row_t rows[GAME_BOARD_HEIGHT];
+    const struct render_backend *backend = render;
+
+    render_frame();
+    if (render == &curses_backend)
+        return;
+
+    render->stop();
+    render = &curses_backend;
+    memcpy(rows, game_view.rows, sizeof (rows));
+    game_view.valid = 0;
+    draw_board_view(&game_view, rows);
+    if (shown.has_next_block)
+        draw_next_block(shown.next_block, shown.next_block_orientation);
+    if (shown.has_score) {
+        shown.has_score = 0;
+        draw_score_board(&shown.score);
+    }
+
+    clearok(curscr, TRUE);
+    curses_frame();
+    frame_pending = 0;
+    render = backend;
 }
 
 
@@ -717,6 +1025,8 @@ int draw_start_game(void)
                             "       R E A D Y ?      "
                             "                        ";
 
+    hand_over_to_curses();
+    game_view.valid = 0;
     wattron(win_game, A_REVERSE | A_BOLD);
     mvwprintw(win_game, 7, 0, message);
     wattroff(win_game, A_REVERSE | A_BOLD);
@@ -743,6 +1053,8 @@ void draw_gameover(int reason)
         "                        ",
     };
 
+    hand_over_to_curses();
+    game_view.valid = 0;
     wattron(win_game, A_REVERSE | A_BOLD);
     mvwprintw(win_game, 7, 0, message[reason]);
     wattroff(win_game, A_REVERSE | A_BOLD);
@@ -762,6 +1074,8 @@ void draw_highscore(int score)
                             "          %8d      "
                             "                        ";
 
+    hand_over_to_curses();
+    game_view.valid = 0;
     wattron(win_game, A_REVERSE | A_BOLD);
     mvwprintw(win_game, 6, 0, message, score);
     wattroff(win_game, A_REVERSE | A_BOLD);
@@ -772,112 +1086,203 @@ void draw_highscore(int score)
     wgetch(win_game);
 }
 
-void draw_level_info(int level)
+
+/*
+ * The cleared rows animations and the level banner are drawn a step at a
+ * time, by whoever runs the screen, each step once its time has come; so no
+ * one sleeps through them. Every animation is a fixed list of steps, the
+ * last one only marking its end.
+ */
+#define ANIMATION_WIDTH     (GAME_BOARD_WIDTH << 1)
+#define LEVEL_INFO_MS       1500
+
+static int animation_steps(animation_t type)
 {
-    const char *message =	"                        "
-                            "     L E V E L   %02d     "
-                            "                        ";
+    switch (type) {
+        case ANIMATION_CLEARED_ROWS_1:
+            return 6;
+        case ANIMATION_CLEARED_ROWS_2:
+            return ANIMATION_WIDTH + 1;
+        case ANIMATION_CLEARED_ROWS_3:
+            return ANIMATION_WIDTH / 2 + 2;
+        case ANIMATION_LEVEL_INFO:
+            return 2;
+        default:
+            return 0;
+    }
+}
 
-    wattron(win_game, A_REVERSE | A_BOLD);
-    mvwprintw(win_game, 7, 0, message, level);
-    wattroff(win_game, A_REVERSE | A_BOLD);
+/* when a step is due, in ms from the start of the animation */
+static int animation_step_time(animation_t type, int step)
+{
+    switch (type) {
+        case ANIMATION_CLEARED_ROWS_1:
+            return step < 5 ? 400 * (step + 1) : 2500;
+        case ANIMATION_CLEARED_ROWS_2:
+        case ANIMATION_CLEARED_ROWS_3:
+            return 300 + 30 * step;
+        case ANIMATION_LEVEL_INFO:
+            return step ? LEVEL_INFO_MS : 0;
+        default:
+            return 0;
+    }
+}
 
-    wrefresh(win_game);
-    wtimeout(win_game, 1500);   /* timeout of 1.5 secs for the getch() below */
-    flushinp();
-    wgetch(win_game);
+static void draw_level_banner(int level)
+{
+    char message[32];
 
-    /* restore the timeout for gameplay */
-    wtimeout(win_game, GAME_INPUT_TIMEOUT);
+    snprintf(message, sizeof (message), "     L E V E L   %02d     ", level);
+
+    game_view.valid = 0;
+    put_text(AREA_GAME, 7, 0, 1, blank_row);
+    put_text(AREA_GAME, 8, 0, 1, message);
+    put_text(AREA_GAME, 9, 0, 1, blank_row);
 }
 
-void draw_cleared_rows_animation_1(int *rows, int count)
+static void draw_animation_step(const struct animation *animation, int step)
 {
-    int j;
-    static const char *empty_row = "                        ";
+    int i, j;
+    const int *rows = animation->rows;
+    int count = animation->count;
 
-    napms(400);
-    for (j = 0; j < count; j++) {
-        mvwprintw(win_game, rows[j], 0, empty_row);
-    }
-    wrefresh(win_game);
-    napms(400);
+    switch (animation->type) {
+        case ANIMATION_CLEARED_ROWS_1:
+            /* blink the rows out, in and out again */
+            for (j = 0; j < count; j++) {
+                if (step & 1)
+                    put_blocks(AREA_GAME, rows[j], 0, GAME_BOARD_WIDTH);
+                else
+                    put_text(AREA_GAME, rows[j], 0, 0, blank_row);
+            }
+            break;
 
-    for (j = 0; j < count; j++) {
-        mvwhline(win_game, rows[j], 0, ACS_CKBOARD, 
-                (GAME_BOARD_WIDTH << 1));
-    }
-    wrefresh(win_game);
-    napms(400);
+        case ANIMATION_CLEARED_ROWS_2:
+            /* wipe every other row from the left, the rest from the right */
+            for (j = animation->direction; j < count; j += 2)
+                put_text(AREA_GAME, rows[j], step, 0, " ");
+            for (j = !animation->direction; j < count; j += 2)
+                put_text(AREA_GAME, rows[j], (ANIMATION_WIDTH - step - 1), 0,
+                        " ");
+            break;
 
-    for (j = 0; j < count; j++) {
-        mvwprintw(win_game, rows[j], 0, empty_row);
-    }
-    wrefresh(win_game);
-    napms(400);
+        case ANIMATION_CLEARED_ROWS_3:
+            /* wipe the rows from both ends in, or from the center out */
+            i = animation->direction ? step : ANIMATION_WIDTH / 2 - step;
+            for (j = 0; j < count; j++) {
+                put_text(AREA_GAME, rows[j], i, 0, " ");
+                put_text(AREA_GAME, rows[j], (ANIMATION_WIDTH - i - 1), 0,
+                        " ");
+            }
+            break;
 
-    for (j = 0; j < count; j++) {
-        mvwhline(win_game, rows[j], 0, ACS_CKBOARD, 
-                (GAME_BOARD_WIDTH << 1));
-    }
-    wrefresh(win_game);
-    napms(400);
+        case ANIMATION_LEVEL_INFO:
+            draw_level_banner(animation->level);
+            break;
 
-    for (j = 0; j < count; j++) {
-        mvwprintw(win_game, rows[j], 0, empty_row);
+        default:
+            break;
     }
-    wrefresh(win_game);
-    napms(500);
 }
 
-void draw_cleared_rows_animation_2(int *rows, int count)
+/* rows (for the cleared rows animations) or level (for the banner) */
+void animation_start(struct animation *animation, animation_t type,
+        const int *rows, int count, int level)
 {
-#define board_width (GAME_BOARD_WIDTH << 1)
-    static int direction = 0;     /* animation from left or right */
+    static int direction = 0;     /* from left or right, center or ends */
+
+    animation->type = type;
+    animation->step = 0;
+    animation->direction = ++direction & 1;
+    animation->level = level;
+    animation->count = count;
+    if (count)
+        memcpy(animation->rows, rows, count * sizeof (*rows));
+
+    if (type == ANIMATION_LEVEL_INFO)
+        game_view.valid = 0;
+    else
+        forget_view_rows(&game_view, rows, count);
+}
 
-    int i, j;
-    int end = direction++ & 1;
-
-    napms(300);
-    for (i = 0; i < board_width; i++) {
-        for (j = end; j < count; j += 2)
-            mvwaddch(win_game, rows[j], i, ' ' | A_NORMAL);
-        for (j = !end; j < count; j += 2)
-            mvwaddch(win_game, rows[j], (board_width - i - 1), ' ' | A_NORMAL);
-        wrefresh(win_game);
-        napms(30);
+/*
+ * Draw every step that's due elapsed_ms into the animation, and return the
+ * ms till the next one is, or -1 once the animation is over. What's drawn
+ * shows with the next render_frame().
+ */
+int animation_update(struct animation *animation, int elapsed_ms)
+{
+    int steps = animation_steps(animation->type);
+
+    while (animation->step < steps &&
+            animation_step_time(animation->type, animation->step) <=
+            elapsed_ms) {
+        if (animation->step < steps - 1)
+            draw_animation_step(animation, animation->step);
+        animation->step++;
     }
-#undef board_width
+
+    if (animation->step == steps)
+        return -1;
+    return animation_step_time(animation->type, animation->step) - elapsed_ms;
 }
 
-void draw_cleared_rows_animation_3(int *rows, int count)
+/* how long an animation runs, in ms */
+int animation_duration(animation_t type)
 {
-#define width (GAME_BOARD_WIDTH << 1)
-    static int direction = 0;     /* animation from center or ends */
+    return animation_step_time(type, animation_steps(type) - 1);
+}
 
-    int i, j;
+/* play a whole animation through, for callers with nothing else to do */
+void animation_run(struct animation *animation)
+{
+    int wait;
+    int elapsed_ms = 0;
 
-    napms(300);
-    if (++direction & 1) {
-        for (i = 0; i <= width / 2; i++) {
-            for (j = 0; j < count; j++) {
-                mvwaddch(win_game, rows[j], i, ' ' | A_NORMAL);
-                mvwaddch(win_game, rows[j], (width - i - 1), ' ' | A_NORMAL);
-            }
-            wrefresh(win_game);
-            napms(30);
-        }
-    } else {
-        for (i = width / 2; i >= 0; i--) {
-            for (j = 0; j < count; j++) {
-                mvwaddch(win_game, rows[j], i, ' ' | A_NORMAL);
-                mvwaddch(win_game, rows[j], (width - i - 1), ' ' | A_NORMAL);
-            }
-            wrefresh(win_game);
-            napms(30);
-        }
+    while ((wait = animation_update(animation, elapsed_ms)) >= 0) {
+        render_frame();
+        napms(wait);
+        elapsed_ms += wait;
     }
-#undef board_width
+    render_frame();
+}
+
+/* before the game starts; any key skips it */
+void draw_level_info(int level)
+{
+    draw_level_banner(level);
+
+    render_frame();
+    wtimeout(win_game, LEVEL_INFO_MS);
+    flushinp();
+    wgetch(win_game);
+
+    /* restore the timeout for gameplay */
+    wtimeout(win_game, GAME_INPUT_TIMEOUT);
+}
+
+void draw_cleared_rows_animation_1(const int *rows, int count)
+{
+    struct animation animation;
+
+    animation_start(&animation, ANIMATION_CLEARED_ROWS_1, rows, count, 0);
+    animation_run(&animation);
+}
+
+void draw_cleared_rows_animation_2(const int *rows, int count)
+{
+    struct animation animation;
+
+    animation_start(&animation, ANIMATION_CLEARED_ROWS_2, rows, count, 0);
+    animation_run(&animation);
+}
+
+void draw_cleared_rows_animation_3(const int *rows, int count)
+{
+    struct animation animation;
+
+    animation_start(&animation, ANIMATION_CLEARED_ROWS_3, rows, count, 0);
+    animation_run(&animation);
 }
 
 /* vim: set ai ts=4 sw=4 tw=80 expandtab: */
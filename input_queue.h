@@ -0,0 +1,73 @@
+#ifndef __INPUT_QUEUE_H__
+#define __INPUT_QUEUE_H__
+
+#include "engine.h"
+
+#include <time.h>
+#include <stddef.h>
+#include <stdatomic.h>
+
+/*
+ * A wait-free ring of timestamped input events, for exactly one producer
+ * (the thread reading the keyboard) and one consumer (the game thread).
+ * Each side owns one of the two indices, which live on cache lines of their
+ * own, and only ever reads the other one.
+ */
+
+#define INPUT_QUEUE_SIZE    256     /* must be a power of two */
+
+struct input_event {
+    input_t input;
+    uint64_t time_ms;               /* since the start of the game */
+#ifdef TETRIZ_LATENCY
+    struct timespec read;           /* when it was read, see latency.h */
+#endif
+};
+
+struct input_queue {
+    _Alignas(64) atomic_size_t head;    /* next event to read */
+    _Alignas(64) atomic_size_t tail;    /* next free slot */
+    _Alignas(64) struct input_event events[INPUT_QUEUE_SIZE];
+};
+
+static inline void input_queue_init(struct input_queue *queue)
+{
+    atomic_init(&queue->head, 0);
+    atomic_init(&queue->tail, 0);
+}
+
+/* producer only; FAILURE if the queue is full */
+static inline int input_queue_push(struct input_queue *queue,
+        const struct input_event *event)
+{
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    size_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+
+    if (tail - head == INPUT_QUEUE_SIZE)
+        return FAILURE;
+
+    queue->events[tail & (INPUT_QUEUE_SIZE - 1)] = *event;
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+
+    return SUCCESS;
+}
+
+/* consumer only; FAILURE if the queue is empty */
+static inline int input_queue_pop(struct input_queue *queue,
+        struct input_event *event)
+{
+    size_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    size_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+
+    if (head == tail)
+        return FAILURE;
+
+    *event = queue->events[head & (INPUT_QUEUE_SIZE - 1)];
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+
+    return SUCCESS;
+}
+
+#endif	/* __INPUT_QUEUE_H__ */
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
@@ -0,0 +1,171 @@
+#include "keyboard.h"
+
+#include <poll.h>
+#include <errno.h>
+#include <unistd.h>
+
+#define KEY_ESCAPE      27
+
+enum {
+    STATE_GROUND,                       /* between keys */
+    STATE_ESCAPE,                       /* after an ESC */
+    STATE_CSI,                          /* after ESC [ */
+    STATE_SS3,                          /* after ESC O */
+    PARSER_STATES,
+};
+
+/* the kinds of bytes, as far as the parser cares */
+enum {
+    CLASS_OTHER,                        /* control characters and such */
+    CLASS_ESCAPE,
+    CLASS_BRACKET,                      /* [ */
+    CLASS_SS3,                          /* O */
+    CLASS_PARAMETER,                    /* space to ?, inside a sequence */
+    CLASS_FINAL,                        /* @ to ~, the end of a sequence */
+    BYTE_CLASSES,
+};
+
+enum {
+    ACTION_NONE,
+    ACTION_KEY,                         /* the byte is a key of its own */
+    ACTION_SEQUENCE,                    /* the byte ends an escape sequence */
+};
+
+struct transition {
+    unsigned char state;
+    unsigned char action;
+};
+
+static const unsigned char byte_classes[256] = {
+    [KEY_ESCAPE] = CLASS_ESCAPE,
+    [' ' ... '?'] = CLASS_PARAMETER,
+    ['@' ... 'N'] = CLASS_FINAL,
+    ['O'] = CLASS_SS3,
+    ['P' ... 'Z'] = CLASS_FINAL,
+    ['['] = CLASS_BRACKET,
+    ['\\' ... '~'] = CLASS_FINAL,
+};
+
+static const struct transition transitions[PARSER_STATES][BYTE_CLASSES] = {
+    [STATE_GROUND] = {
+        [CLASS_OTHER]       = { STATE_GROUND, ACTION_KEY },
+        [CLASS_ESCAPE]      = { STATE_ESCAPE, ACTION_NONE },
+        [CLASS_BRACKET]     = { STATE_GROUND, ACTION_KEY },
+        [CLASS_SS3]         = { STATE_GROUND, ACTION_KEY },
+        [CLASS_PARAMETER]   = { STATE_GROUND, ACTION_KEY },
+        [CLASS_FINAL]       = { STATE_GROUND, ACTION_KEY },
+    },
+    [STATE_ESCAPE] = {
+        /* ESC ESC is the Escape key, followed by whatever comes next */
+        [CLASS_OTHER]       = { STATE_GROUND, ACTION_KEY },
+        [CLASS_ESCAPE]      = { STATE_ESCAPE, ACTION_KEY },
+        [CLASS_BRACKET]     = { STATE_CSI, ACTION_NONE },
+        [CLASS_SS3]         = { STATE_SS3, ACTION_NONE },
+        [CLASS_PARAMETER]   = { STATE_GROUND, ACTION_KEY },   /* alt + key */
+        [CLASS_FINAL]       = { STATE_GROUND, ACTION_KEY },
+    },
+    [STATE_CSI] = {
+        [CLASS_OTHER]       = { STATE_GROUND, ACTION_NONE },  /* garbled */
+        [CLASS_ESCAPE]      = { STATE_ESCAPE, ACTION_NONE },
+        [CLASS_BRACKET]     = { STATE_GROUND, ACTION_SEQUENCE },
+        [CLASS_SS3]         = { STATE_GROUND, ACTION_SEQUENCE },
+        [CLASS_PARAMETER]   = { STATE_CSI, ACTION_NONE },
+        [CLASS_FINAL]       = { STATE_GROUND, ACTION_SEQUENCE },
+    },
+    [STATE_SS3] = {
+        [CLASS_OTHER]       = { STATE_GROUND, ACTION_NONE },
+        [CLASS_ESCAPE]      = { STATE_ESCAPE, ACTION_NONE },
+        [CLASS_BRACKET]     = { STATE_GROUND, ACTION_SEQUENCE },
+        [CLASS_SS3]         = { STATE_GROUND, ACTION_SEQUENCE },
+        [CLASS_PARAMETER]   = { STATE_SS3, ACTION_NONE },
+        [CLASS_FINAL]       = { STATE_GROUND, ACTION_SEQUENCE },
+    },
+};
+
+/* the keys on their own, as translate_input() has them in graphics.c */
+static const input_t plain_keys[256] = {
+    ['A'] = INPUT_MOVE_LEFT,    ['a'] = INPUT_MOVE_LEFT,
+    ['D'] = INPUT_MOVE_RIGHT,   ['d'] = INPUT_MOVE_RIGHT,
+    ['S'] = INPUT_MOVE_DOWN,    ['s'] = INPUT_MOVE_DOWN,
+    [' '] = INPUT_MOVE_UP_DROP,
+    ['J'] = INPUT_ROTATE_LEFT,  ['j'] = INPUT_ROTATE_LEFT,
+    ['Z'] = INPUT_ROTATE_LEFT,  ['z'] = INPUT_ROTATE_LEFT,
+    ['K'] = INPUT_ROTATE_RIGHT, ['k'] = INPUT_ROTATE_RIGHT,
+    ['X'] = INPUT_ROTATE_RIGHT, ['x'] = INPUT_ROTATE_RIGHT,
+    [KEY_ESCAPE] = INPUT_PAUSE_QUIT,
+    ['Q'] = INPUT_PAUSE_QUIT,   ['q'] = INPUT_PAUSE_QUIT,
+    ['P'] = INPUT_PAUSE_QUIT,   ['p'] = INPUT_PAUSE_QUIT,
+};
+
+/* the arrow keys, by the last byte of their sequence (up does nothing) */
+static const input_t sequence_keys[256] = {
+    ['B'] = INPUT_MOVE_DOWN,
+    ['C'] = INPUT_MOVE_RIGHT,
+    ['D'] = INPUT_MOVE_LEFT,
+};
+
+
+void keyboard_init(struct keyboard *keyboard, int fd)
+{
+    keyboard->fd = fd;
+    keyboard->state = STATE_GROUND;
+}
+
+/*
+ * Wait up to timeout ms (-1 for ever) for input, and parse one read() worth
+ * of it into at most max inputs (keys that mean nothing are left out); all
+ * of them arrived at *arrival. Returns how many there were, or -1 if the
+ * terminal is gone.
+ */
+int keyboard_read(struct keyboard *keyboard, input_t *inputs, int max,
+        int timeout, struct timespec *arrival)
+{
+    int i, count = 0;
+    ssize_t length;
+    input_t input;
+    unsigned char bytes[KEYBOARD_READ_SIZE];
+    const struct transition *transition;
+    struct pollfd fd = { keyboard->fd, POLLIN, 0 };
+
+    if (poll(&fd, 1, timeout) <= 0)
+        return 0;
+
+    /* no byte ever makes more than one input */
+    if (max > KEYBOARD_READ_SIZE)
+        max = KEYBOARD_READ_SIZE;
+
+    length = read(keyboard->fd, bytes, max);
+    clock_gettime(CLOCK_MONOTONIC, arrival);
+    if (length <= 0)
+        return (length < 0 && (errno == EINTR || errno == EAGAIN)) ? 0 : -1;
+
+    for (i = 0; i < length; i++) {
+        transition = &transitions[keyboard->state][byte_classes[bytes[i]]];
+        keyboard->state = transition->state;
+
+        switch (transition->action) {
+            case ACTION_KEY:
+                input = plain_keys[bytes[i]];
+                break;
+            case ACTION_SEQUENCE:
+                input = sequence_keys[bytes[i]];
+                break;
+            default:
+                input = INPUT_TIMEOUT;
+                break;
+        }
+
+        if (input != INPUT_TIMEOUT)
+            inputs[count++] = input;
+    }
+
+    /* nothing came after the ESC, so it's the Escape key, see keyboard.h */
+    if (keyboard->state == STATE_ESCAPE) {
+        inputs[count++] = plain_keys[KEY_ESCAPE];
+        keyboard->state = STATE_GROUND;
+    }
+
+    return count;
+}
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
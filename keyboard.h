@@ -0,0 +1,33 @@
+#ifndef __KEYBOARD_H__
+#define __KEYBOARD_H__
+
+#include "engine.h"
+
+#include <time.h>
+
+/*
+ * Keyboard input read straight from the terminal, without curses. Whatever
+ * one read() returns goes through a small table driven parser, which knows
+ * the escape sequences of the arrow keys (both the CSI "ESC [ x" and the
+ * SS3 "ESC O x" forms, with or without parameters) and maps everything to
+ * the same input_t values curses input gives.
+ *
+ * A terminal sends a whole escape sequence in one go, so an ESC that ends
+ * what was read is taken to be the Escape key right away, instead of waiting
+ * (as curses does, for ESCDELAY) to see whether more is coming.
+ */
+
+#define KEYBOARD_READ_SIZE      64      /* bytes taken per read() at most */
+
+struct keyboard {
+    int fd;
+    int state;                          /* of the escape sequence parser */
+};
+
+void keyboard_init(struct keyboard *keyboard, int fd);
+int keyboard_read(struct keyboard *keyboard, input_t *inputs, int max,
+        int timeout, struct timespec *arrival);
+
+#endif	/* __KEYBOARD_H__ */
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
@@ -0,0 +1,216 @@
+#include "latency.h"
+
+#ifdef TETRIZ_LATENCY
+
+#include "engine.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <unistd.h>
+
+#define DUMP_LINE_SIZE      128
+
+struct histogram input_latency = { "input latency", 0, 0, UINT64_MAX, 0,
+    { 0 } };
+struct histogram tick_lateness = { "gravity tick lateness", 0, 0,
+    UINT64_MAX, 0, { 0 } };
+
+static struct histogram *histograms[] = { &input_latency, &tick_lateness };
+
+/* the percentiles dumped, in thousandths */
+static const int percentiles[] = { 500, 900, 990, 999 };
+
+static int bucket_index(uint64_t us)
+{
+    int exponent;
+
+    if (us < HISTOGRAM_SUB_BUCKETS)
+        return (int)us;
+    if (us >> 32)
+        return HISTOGRAM_BUCKETS - 1;
+
+    exponent = 63 - __builtin_clzll(us);
+    return (exponent - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS +
+        (int)(us >> (exponent - HISTOGRAM_SUB_BITS)) - HISTOGRAM_SUB_BUCKETS;
+}
+
+/* the smallest value in a bucket, and the one just past it */
+static void bucket_bounds(int index, uint64_t *low, uint64_t *high)
+{
+    int shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+
+    if (shift < 0) {
+        *low = index;
+        *high = index + 1;
+        return;
+    }
+
+    *low = (uint64_t)(HISTOGRAM_SUB_BUCKETS + index % HISTOGRAM_SUB_BUCKETS)
+        << shift;
+    *high = *low + ((uint64_t)1 << shift);
+}
+
+void histogram_record(struct histogram *histogram, uint64_t us)
+{
+    histogram->buckets[bucket_index(us)]++;
+    histogram->count++;
+    histogram->sum += us;
+    if (us < histogram->min)
+        histogram->min = us;
+    if (us > histogram->max)
+        histogram->max = us;
+}
+
+/* the highest value the given share of them stays within */
+static uint64_t histogram_percentile(const struct histogram *histogram,
+        int thousandths)
+{
+    int i;
+    uint64_t low, high;
+    uint64_t seen = 0;
+    uint64_t wanted = (histogram->count * thousandths + 999) / 1000;
+
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= wanted && seen) {
+            bucket_bounds(i, &low, &high);
+            return high - 1 < histogram->max ? high - 1 : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
+
+/*
+ * The dump is put together by hand, as it's also done from the signal
+ * handler, where stdio can't be used.
+ */
+struct dump_line {
+    char text[DUMP_LINE_SIZE];
+    int length;
+};
+
+static void put_string(struct dump_line *line, const char *string)
+{
+    while (*string && line->length < DUMP_LINE_SIZE)
+        line->text[line->length++] = *string++;
+}
+
+static void put_number(struct dump_line *line, uint64_t number, int width)
+{
+    char digits[24];
+    int count = 0;
+
+    do {
+        digits[count++] = '0' + number % 10;
+        number /= 10;
+    } while (number);
+
+    for (; width > count && line->length < DUMP_LINE_SIZE; width--)
+        line->text[line->length++] = ' ';
+    while (count-- && line->length < DUMP_LINE_SIZE)
+        line->text[line->length++] = digits[count];
+}
+
+static void put_percentile(struct dump_line *line, int thousandths)
+{
+    put_string(line, " p");
+    put_number(line, thousandths / 10, 0);
+    if (thousandths % 10) {
+        put_string(line, ".");
+        put_number(line, thousandths % 10, 0);
+    }
+    put_string(line, " ");
+}
+
+static void write_line(int fd, struct dump_line *line)
+{
+    ssize_t written;
+    int offset = 0;
+
+    put_string(line, "\n");
+    while (offset < line->length) {
+        written = write(fd, line->text + offset, line->length - offset);
+        if (written <= 0)
+            break;
+        offset += written;
+    }
+
+    line->length = 0;
+}
+
+static void dump_histogram(int fd, const struct histogram *histogram)
+{
+    int i;
+    uint64_t low, high;
+    struct dump_line line = { "", 0 };
+
+    put_string(&line, histogram->name);
+    put_string(&line, " (us): ");
+    put_number(&line, histogram->count, 0);
+    put_string(&line, " samples");
+    if (histogram->count) {
+        put_string(&line, ", min ");
+        put_number(&line, histogram->min, 0);
+        put_string(&line, ", mean ");
+        put_number(&line, histogram->sum / histogram->count, 0);
+        put_string(&line, ", max ");
+        put_number(&line, histogram->max, 0);
+    }
+    write_line(fd, &line);
+
+    if (!histogram->count)
+        return;
+
+    for (i = 0; i < ARRAY_LEN(percentiles); i++) {
+        put_percentile(&line, percentiles[i]);
+        put_number(&line, histogram_percentile(histogram, percentiles[i]), 0);
+    }
+    write_line(fd, &line);
+
+    for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+        if (!histogram->buckets[i])
+            continue;
+
+        bucket_bounds(i, &low, &high);
+        put_number(&line, low, 12);
+        put_string(&line, " - ");
+        put_number(&line, high - 1, 10);
+        put_string(&line, ": ");
+        put_number(&line, histogram->buckets[i], 0);
+        write_line(fd, &line);
+    }
+}
+
+void latency_dump(int fd)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_LEN(histograms); i++)
+        dump_histogram(fd, histograms[i]);
+}
+
+static void dump_on_signal(int signal)
+{
+    int saved_errno = errno;
+
+    (void)signal;
+    latency_dump(STDERR_FILENO);
+    errno = saved_errno;
+}
+
+void latency_init(void)
+{
+    struct sigaction action;
+
+    memset(&action, 0, sizeof (action));
+    action.sa_handler = dump_on_signal;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGUSR1, &action, NULL);
+}
+
+#endif	/* TETRIZ_LATENCY */
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
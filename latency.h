@@ -0,0 +1,58 @@
+#ifndef __LATENCY_H__
+#define __LATENCY_H__
+
+/*
+ * Latency histograms, built in with -DTETRIZ_LATENCY (see the Makefile):
+ * how long every key takes from being read to being on the screen, and how
+ * late every gravity tick comes after it was due. Values are in us, and go
+ * into fixed log-linear buckets, as in HDR histograms: exact below 16 us,
+ * then 16 buckets for each power of two, so that no value is off by more
+ * than 1/16. Recording one is a few instructions, with no locks, as every
+ * histogram has a single thread writing to it.
+ *
+ * They are dumped on stderr on exit, and whenever the game gets a SIGUSR1
+ * (so stderr had better go somewhere other than the terminal). Without
+ * TETRIZ_LATENCY, none of this is compiled in at all.
+ */
+
+#ifdef TETRIZ_LATENCY
+
+#include <stdint.h>
+#include <time.h>
+
+#define HISTOGRAM_SUB_BITS      4
+#define HISTOGRAM_SUB_BUCKETS   (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS       \
+    ((32 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+struct histogram {
+    const char *name;
+    uint64_t count;
+    uint64_t sum;
+    uint64_t min;
+    uint64_t max;
+    uint64_t buckets[HISTOGRAM_BUCKETS];
+};
+
+extern struct histogram input_latency;  /* key read to frame shown */
+extern struct histogram tick_lateness;  /* gravity tick due to applied */
+
+void latency_init(void);
+void histogram_record(struct histogram *histogram, uint64_t us);
+void latency_dump(int fd);
+
+/* us from one time to a later one, 0 if it isn't later */
+static inline uint64_t us_between(const struct timespec *start,
+        const struct timespec *end)
+{
+    int64_t ns = (int64_t)(end->tv_sec - start->tv_sec) * 1000000000 +
+        (end->tv_nsec - start->tv_nsec);
+
+    return ns > 0 ? (uint64_t)ns / 1000 : 0;
+}
+
+#endif	/* TETRIZ_LATENCY */
+
+#endif	/* __LATENCY_H__ */
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
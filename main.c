@@ -1,22 +1,58 @@
 #include "tetriz.h"
+#include "latency.h"
+#include "stats.h"
 
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
+#include <getopt.h>
+#include <unistd.h>
 
 const char *prog_name = NULL;
 
-static int do_initialization(int argc, char **argv);
+static const char *replay_path = NULL;  /* --replay */
+static int fast_replay = 0;             /* --fast */
+static int show_render_stats = 0;       /* --render-stats */
+
+static int parse_command_line_arguments(int argc, char **argv);
+static int do_initialization(void);
+static void print_render_stats(void);
 
 int main(int argc, char **argv)
 {
     int ret;
     int choice;
 
-    ret = do_initialization(argc, argv);		/* initialize everything */
+    /* get the name the program was invoked with */
+    prog_name = strrchr(*argv, '/');
+    prog_name = prog_name ? (prog_name + 1) : *argv;
+
+    if (parse_command_line_arguments(argc, argv))
+        return FAILURE;
+
+#ifdef TETRIZ_STATS
+    stats_init();
+#endif
+
+    /* a fast replay doesn't need the terminal at all */
+    if (replay_path && fast_replay) {
+        ret = play_replay(replay_path, 1);
+#ifdef TETRIZ_STATS
+        stats_dump(stderr);
+#endif
+        return ret;
+    }
+
+    ret = do_initialization();		/* initialize everything */
     if (ret)
         return FAILURE;
 
+    if (replay_path) {
+        ret = play_replay(replay_path, 0);
+        deinitialize_graphics();
+        return ret;
+    }
+
     do {
         choice = display_main_menu();
 
@@ -40,16 +76,141 @@ int main(int argc, char **argv)
 
     deinitialize_graphics();
 
+    if (record_failed)
+        fprintf(stderr, "%s: failed to record the replay '%s'\n", prog_name,
+                record_path);
+
+    if (show_input_stats)
+        fprintf(stderr, "%s: %llu inputs in %llu frames, %.2f per frame, "
+                "at most %d\n", prog_name,
+                (unsigned long long)input_stats.inputs,
+                (unsigned long long)input_stats.frames,
+                input_stats.frames ?
+                (double)input_stats.inputs / input_stats.frames : 0.0,
+                input_stats.max);
+
+    if (show_render_stats)
+        print_render_stats();
+
+#ifdef TETRIZ_LATENCY
+    latency_dump(STDERR_FILENO);
+#endif
+#ifdef TETRIZ_STATS
+    stats_dump(stderr);
+#endif
+
     return 0;
 }
 
-static int do_initialization(int argc, char **argv)
+static void usage(void)
 {
-    int ret = argc; /* FIXME: assignment is to avoid warning for unused argc */
+    fprintf(stderr,
+            "usage: %s [--record FILE] [--event-loop] [--raw-input]"
+            " [--input-stats]\n"
+            "          [--render NAME] [--render-stats]\n"
+            "       %s --replay FILE [--fast]\n\n"
+            "  --record FILE   save a replay of every new game to FILE\n"
+            "  --event-loop    run the game on a single thread, driven by a"
+            " timer\n"
+            "  --raw-input     read the keyboard straight from the terminal,"
+            " not through\n"
+            "                  curses (no delay on Escape)\n"
+            "  --input-stats   on exit, print how many inputs each frame"
+            " took in\n"
+            "  --render NAME   draw the game with ncurses (the default), ansi"
+            " (straight to\n"
+            "                  the terminal, one write a frame) or null"
+            " (not at all)\n"
+            "  --render-stats  on exit, print how many frames were drawn, and"
+            " what they took\n"
+            "  --replay FILE   play back the replay in FILE at its recorded"
+            " speed\n"
+            "  --fast          with --replay: replay as fast as possible,"
+            " without drawing,\n"
+            "                  and check the result against the recording\n",
+            prog_name, prog_name);
+}
 
-    /* get the name the program was invoked with */
-    prog_name = strrchr(*argv, '/');
-    prog_name = prog_name ? (prog_name + 1) : *argv;
+static void print_render_stats(void)
+{
+    unsigned long long frames = render_stats.frames;
+
+    fprintf(stderr, "%s: %s renderer: %llu frames", prog_name,
+            renderer_name(), frames);
+
+    /* curses does its own writing, so there's nothing to count */
+    if (render_stats.writes)
+        fprintf(stderr, ", %llu writes, %llu bytes, %.1f bytes per frame",
+                (unsigned long long)render_stats.writes,
+                (unsigned long long)render_stats.bytes,
+                frames ? (double)render_stats.bytes / frames : 0.0);
+    fputc('\n', stderr);
+}
+
+static int parse_command_line_arguments(int argc, char **argv)
+{
+    int opt;
+    static const struct option long_options[] = {
+        { "record", required_argument, NULL, 'r' },
+        { "replay", required_argument, NULL, 'p' },
+        { "fast",   no_argument,       NULL, 'f' },
+        { "event-loop", no_argument,   NULL, 'e' },
+        { "raw-input", no_argument,    NULL, 'k' },
+        { "input-stats", no_argument,  NULL, 'i' },
+        { "render", required_argument, NULL, 'd' },
+        { "render-stats", no_argument, NULL, 's' },
+        { "help",   no_argument,       NULL, 'h' },
+        { NULL, 0, NULL, 0 },
+    };
+
+    while ((opt = getopt_long(argc, argv, "r:p:fekid:sh", long_options,
+                    NULL)) != -1) {
+        switch (opt) {
+            case 'r':
+                record_path = optarg;
+                break;
+            case 'p':
+                replay_path = optarg;
+                break;
+            case 'f':
+                fast_replay = 1;
+                break;
+            case 'e':
+                event_loop = 1;
+                break;
+            case 'k':
+                raw_input = 1;
+                break;
+            case 'i':
+                show_input_stats = 1;
+                break;
+            case 'd':
+                if (select_renderer(optarg) == FAILURE) {
+                    fprintf(stderr, "%s: no such renderer '%s'\n",
+                            prog_name, optarg);
+                    return FAILURE;
+                }
+                break;
+            case 's':
+                show_render_stats = 1;
+                break;
+            default:
+                usage();
+                return FAILURE;
+        }
+    }
+
+    if (optind != argc || (fast_replay && !replay_path)) {
+        usage();
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+static int do_initialization(void)
+{
+    int ret;
 
     /* install exit-handler */
     if (atexit(deinitialize_graphics)) {
@@ -57,8 +218,6 @@ static int do_initialization(int argc, char **argv)
         return FAILURE;
     }
 
-    // parse_command_line_arguments(argc, argv);
-
     ret = initialize_graphics();
     if (ret) {
         fprintf(stderr, "%s: failed to initialize graphics [%d]\n", 
@@ -66,12 +225,9 @@ static int do_initialization(int argc, char **argv)
         return ret;
     }
 
-    ret = initialize_game_elements();
-    if (ret) {
-        fprintf(stderr, "%s: failed to initialize game elements [%d]\n", 
-                prog_name, ret);
-        return ret;
-    }
+#ifdef TETRIZ_LATENCY
+    latency_init();                 /* dump the histograms on SIGUSR1 */
+#endif
 
     return ret;
 }
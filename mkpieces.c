@@ -0,0 +1,213 @@
+#include "engine.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Build-time generator for piece_tables.c: turns the cell coordinates in
+ * positions[] into the row masks, bounding boxes and column profiles that
+ * the engine reads on its hot paths, and works out which orientations of a
+ * block are duplicates of each other. It also draws the random keys of the
+ * Zobrist hashes of boards, from a fixed seed so that every build hashes a
+ * board the same way.
+ */
+
+#define ZOBRIST_SEED    0x7e7215ULL
+
+static const char *block_names[TOTAL_BLOCKS] = {
+    "BLOCK_SQUARE", "BLOCK_LINE", "BLOCK_TEE", "BLOCK_ZEE_1", "BLOCK_ZEE_2",
+    "BLOCK_ELL_1", "BLOCK_ELL_2",
+};
+
+static const char *degree_names[TOTAL_DEGREES] = {
+    "DEG_0", "DEG_90", "DEG_180", "DEG_270",
+};
+
+/* the 4x4 grid of a position as a 16 bit mask, for comparing shapes */
+static unsigned grid_mask(const struct position *position)
+{
+    int i;
+    unsigned mask = 0;
+
+    for (i = 0; i < ARRAY_LEN(position->pos); i++)
+        mask |= 1u << (position->pos[i].y * 4 + position->pos[i].x);
+
+    return mask;
+}
+
+/* splitmix64, which is plenty random enough for hash keys */
+static uint64_t next_key(uint64_t *state)
+{
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+/* count keys, two a line, indented as given */
+static void print_keys(const char *name, int count, int indent,
+        uint64_t *state)
+{
+    int i;
+
+    printf("%*s/* %s */\n%*s", indent, "", name, indent - 1, "");
+    for (i = 0; i < count; i++) {
+        printf(" 0x%016llxULL,", (unsigned long long)next_key(state));
+        if (i % 2 == 1 && i < count - 1)
+            printf("\n%*s", indent - 1, "");
+    }
+    printf("\n");
+}
+
+/*
+ * FAILURE unless every column of the bounding box has a cell: the engine
+ * relies on it to catch blocks sticking out past the right wall (see
+ * test_movement() and fitting()), as their cells there go off the row.
+ */
+static int check_columns(const struct piece_shape *shape)
+{
+    int x;
+
+    for (x = 0; x <= shape->x1 - shape->x0; x++) {
+        if (shape->bottom[x] < 0)
+            return FAILURE;
+    }
+    return SUCCESS;
+}
+
+static void compute_shape(const struct position *position,
+        struct piece_shape *shape)
+{
+    int i;
+
+    memset(shape, 0, sizeof (*shape));
+    shape->x0 = shape->y0 = 3;
+    memset(shape->bottom, -1, sizeof (shape->bottom));
+
+    for (i = 0; i < ARRAY_LEN(position->pos); i++) {
+        int x = position->pos[i].x;
+        int y = position->pos[i].y;
+
+        if (x < shape->x0)
+            shape->x0 = x;
+        if (x > shape->x1)
+            shape->x1 = x;
+        if (y < shape->y0)
+            shape->y0 = y;
+        if (y > shape->y1)
+            shape->y1 = y;
+    }
+
+    for (i = 0; i < ARRAY_LEN(position->pos); i++) {
+        int x = position->pos[i].x - shape->x0;
+        int y = position->pos[i].y;
+
+        shape->rows[y] |= 1u << x;
+        if (y > shape->bottom[x])
+            shape->bottom[x] = y;
+    }
+}
+
+int main(void)
+{
+    int i, j, k;
+    uint64_t state = ZOBRIST_SEED;
+    struct piece_shape shape;
+    int rotations[TOTAL_BLOCKS];
+    degree_t canonical[TOTAL_BLOCKS][TOTAL_DEGREES];
+    degree_t unique[TOTAL_BLOCKS][TOTAL_DEGREES];
+
+    for (i = 0; i < TOTAL_BLOCKS; i++) {
+        rotations[i] = 0;
+
+        for (j = 0; j < TOTAL_DEGREES; j++) {
+            compute_shape(&positions[i][j], &shape);
+            if (check_columns(&shape) == FAILURE) {
+                fprintf(stderr, "mkpieces: %s %s has an empty column\n",
+                        block_names[i], degree_names[j]);
+                return FAILURE;
+            }
+
+            canonical[i][j] = j;
+            for (k = 0; k < j; k++) {
+                if (grid_mask(&positions[i][k]) ==
+                        grid_mask(&positions[i][j])) {
+                    canonical[i][j] = canonical[i][k];
+                    break;
+                }
+            }
+
+            if (canonical[i][j] == (degree_t)j)
+                unique[i][rotations[i]++] = j;
+        }
+
+        /* list the duplicates after the distinct orientations */
+        for (j = 0, k = rotations[i]; j < TOTAL_DEGREES; j++) {
+            if (canonical[i][j] != (degree_t)j)
+                unique[i][k++] = j;
+        }
+    }
+
+    printf("/* generated by mkpieces from pieces.c -- do not edit */\n\n");
+    printf("#include \"engine.h\"\n\n");
+
+    printf("const struct piece_shape "
+            "piece_shapes[TOTAL_BLOCKS][TOTAL_DEGREES] = {\n");
+    for (i = 0; i < TOTAL_BLOCKS; i++) {
+        printf("    /* %s */\n    {\n", block_names[i]);
+
+        for (j = 0; j < TOTAL_DEGREES; j++) {
+            compute_shape(&positions[i][j], &shape);
+            printf("        { { 0x%x, 0x%x, 0x%x, 0x%x }, %d, %d, %d, %d, "
+                    "{ %d, %d, %d, %d }, %s },\t/* %s */\n",
+                    shape.rows[0], shape.rows[1], shape.rows[2],
+                    shape.rows[3], shape.x0, shape.x1, shape.y0, shape.y1,
+                    shape.bottom[0], shape.bottom[1], shape.bottom[2],
+                    shape.bottom[3], degree_names[canonical[i][j]],
+                    degree_names[j]);
+        }
+
+        printf("    },\n");
+    }
+    printf("};\n\n");
+
+    printf("const int piece_rotations[TOTAL_BLOCKS] = {\n   ");
+    for (i = 0; i < TOTAL_BLOCKS; i++)
+        printf(" %d,", rotations[i]);
+    printf("\n};\n\n");
+
+    printf("const degree_t "
+            "piece_orientations[TOTAL_BLOCKS][TOTAL_DEGREES] = {\n");
+    for (i = 0; i < TOTAL_BLOCKS; i++) {
+        printf("    {");
+        for (j = 0; j < TOTAL_DEGREES; j++)
+            printf(" %s,", degree_names[unique[i][j]]);
+        printf(" },\t/* %s */\n", block_names[i]);
+    }
+    printf("};\n\n");
+
+    printf("const uint64_t "
+            "zobrist_cells[GAME_BOARD_HEIGHT][GAME_BOARD_WIDTH] = {\n");
+    for (i = 0; i < GAME_BOARD_HEIGHT; i++) {
+        char name[16];
+
+        snprintf(name, sizeof (name), "row %d", i);
+        printf("    {\n");
+        print_keys(name, GAME_BOARD_WIDTH, 8, &state);
+        printf("    },\n");
+    }
+    printf("};\n\n");
+
+    printf("const uint64_t zobrist_current[TOTAL_BLOCKS] = {\n");
+    print_keys("the current block", TOTAL_BLOCKS, 4, &state);
+    printf("};\n\n");
+
+    printf("const uint64_t zobrist_next[TOTAL_BLOCKS] = {\n");
+    print_keys("the next block", TOTAL_BLOCKS, 4, &state);
+    printf("};\n");
+
+    return 0;
+}
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
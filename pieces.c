@@ -0,0 +1,60 @@
+#include "engine.h"
+
+/*
+ * The cells occupied by each block in each orientation, within a 4x4 grid
+ * whose top-left corner is the block's origin. This is the one place the
+ * block shapes are defined; mkpieces derives piece_shapes[] from it.
+ */
+const struct position positions[TOTAL_BLOCKS][TOTAL_DEGREES] = {
+    /* BLOCK_SQUARE */
+    {
+        { { { 1, 1 }, { 2, 1 }, { 1, 2 }, { 2, 2 } } },			/* DEG_0 */
+        { { { 1, 1 }, { 2, 1 }, { 1, 2 }, { 2, 2 } } },			/* DEG_90 */
+        { { { 1, 1 }, { 2, 1 }, { 1, 2 }, { 2, 2 } } },			/* DEG_180 */
+        { { { 1, 1 }, { 2, 1 }, { 1, 2 }, { 2, 2 } } },			/* DEG_270 */
+    },
+    /* BLOCK_LINE */
+    {
+        { { { 0, 1 }, { 1, 1 }, { 2, 1 }, { 3, 1 } } },			/* DEG_0 */
+        { { { 2, 0 }, { 2, 1 }, { 2, 2 }, { 2, 3 } } },			/* DEG_90 */
+        { { { 0, 1 }, { 1, 1 }, { 2, 1 }, { 3, 1 } } },			/* DEG_180 */
+        { { { 2, 0 }, { 2, 1 }, { 2, 2 }, { 2, 3 } } },			/* DEG_270 */
+    },
+    /* BLOCK_TEE */
+    {
+        { { { 2, 0 }, { 1, 1 }, { 2, 1 }, { 3, 1 } } },			/* DEG_0 */
+        { { { 2, 0 }, { 2, 1 }, { 2, 2 }, { 3, 1 } } },			/* DEG_90 */
+        { { { 2, 2 }, { 1, 1 }, { 2, 1 }, { 3, 1 } } },			/* DEG_180 */
+        { { { 2, 0 }, { 2, 1 }, { 2, 2 }, { 1, 1 } } },			/* DEG_270 */
+    },
+    /* BLOCK_ZEE_1 */
+    {
+        { { { 2, 0 }, { 1, 1 }, { 2, 1 }, { 1, 2 } } },			/* DEG_0 */
+        { { { 1, 1 }, { 2, 1 }, { 2, 2 }, { 3, 2 } } },			/* DEG_90 */
+        { { { 2, 0 }, { 1, 1 }, { 2, 1 }, { 1, 2 } } },			/* DEG_180 */
+        { { { 1, 1 }, { 2, 1 }, { 2, 2 }, { 3, 2 } } },			/* DEG_270 */
+    },
+    /* BLOCK_ZEE_2 */
+    {
+        { { { 1, 0 }, { 1, 1 }, { 2, 1 }, { 2, 2 } } },			/* DEG_0 */
+        { { { 1, 1 }, { 2, 1 }, { 0, 2 }, { 1, 2 } } },			/* DEG_90 */
+        { { { 1, 0 }, { 1, 1 }, { 2, 1 }, { 2, 2 } } },			/* DEG_180 */
+        { { { 1, 1 }, { 2, 1 }, { 0, 2 }, { 1, 2 } } },			/* DEG_270 */
+    },
+    /* BLOCK_ELL_1 */
+    {
+        { { { 1, 0 }, { 1, 1 }, { 1, 2 }, { 2, 2 } } },			/* DEG_0 */
+        { { { 1, 1 }, { 2, 1 }, { 3, 1 }, { 1, 2 } } },			/* DEG_90 */
+        { { { 1, 0 }, { 2, 0 }, { 2, 1 }, { 2, 2 } } },			/* DEG_180 */
+        { { { 2, 0 }, { 0, 1 }, { 1, 1 }, { 2, 1 } } },			/* DEG_270 */
+    },
+    /* BLOCK_ELL_2 */
+    {
+        { { { 2, 0 }, { 2, 1 }, { 2, 2 }, { 1, 2 } } },			/* DEG_0 */
+        { { { 1, 0 }, { 1, 1 }, { 2, 1 }, { 3, 1 } } },			/* DEG_90 */
+        { { { 1, 0 }, { 2, 0 }, { 1, 1 }, { 1, 2 } } },			/* DEG_180 */
+        { { { 0, 1 }, { 1, 1 }, { 2, 1 }, { 2, 2 } } },			/* DEG_270 */
+    },
+};
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
@@ -0,0 +1,248 @@
+#include "engine.h"
+
+#include <assert.h>
+#include <string.h>
+
+/*
+ * Everything the block can reach, soft drops tucked under overhangs and
+ * turns slid in at the bottom included: a breadth first search over where it
+ * can be (its column, row and orientation), moving it one input at a time,
+ * just as move_block() would. Orientations with the same cells count as the
+ * same state, so that the square, the line and the zees aren't searched over
+ * and over, and whether a state has been seen is a bit in a bitset the size
+ * of the board. The queue is a fixed array too, so a search takes nothing
+ * off the heap.
+ *
+ * Where the block fits is worked out up front, a whole row of columns at a
+ * time (see fitting()), so that each move tried is a single bit test.
+ * And above the highest filled cell every row is the same as every other:
+ * the block can move and turn the same way in any of them. So from up there,
+ * the block falls straight to the last of those rows before anything else is
+ * tried, rather than every move being tried in every row.
+ */
+
+#define ORIGIN_X_BIAS       3           /* origin.x goes down to -x0 */
+
+#define SEARCH_STATES       \
+    (TOTAL_DEGREES * GAME_BOARD_HEIGHT * (GAME_BOARD_WIDTH + ORIGIN_X_BIAS))
+
+struct search_state {
+    int8_t x, y;                        /* the origin */
+    uint8_t orientation;
+    uint8_t input;                      /* what took it here, an input_t */
+    uint8_t falls;                      /* or the rows it fell to get here */
+    int16_t parent;                     /* -1 for where the block is now */
+};
+
+/* both by the canonical orientation and origin.y, over origin.x + bias */
+struct search {
+    uint16_t fits[TOTAL_DEGREES][GAME_BOARD_HEIGHT + 1];
+    uint16_t seen[TOTAL_DEGREES][GAME_BOARD_HEIGHT];
+    struct search_state states[SEARCH_STATES];
+    int count;
+};
+
+_Static_assert(SEARCH_STATES <= INT16_MAX, "a parent must fit in an int16_t");
+_Static_assert(GAME_BOARD_WIDTH + 2 + ORIGIN_X_BIAS - 1 <= 16,
+        "the columns fitting() shifts up must fit in a uint16_t");
+
+/*
+ * Where in row y (its origin.y) the block fits, as test_movement() would
+ * have it, for every origin.x at once: the block is blocked at a shift
+ * wherever one of its cells, at that shift, lands on a filled cell (or a
+ * wall). Any shift too far left or right for the board puts some cell on a
+ * wall, and rows past the bottom sentinel don't fit at all.
+ *
+ * Cells shifted past the right wall find nothing there to block them, so
+ * this relies on every block having a cell in each column of its bounding
+ * box (mkpieces checks): any shift reaching past the wall has one on it.
+ */
+static uint16_t fitting(const struct game_state *game,
+        const struct piece_shape *shape, int y)
+{
+    int i;
+    int row = y + 1;
+    unsigned int cells, blocked = 0;    /* by the board bit of column x0 */
+
+    if (row + shape->y1 > GAME_BOARD_HEIGHT + 1)
+        return 0;
+
+    for (i = shape->y0; i <= shape->y1; i++) {
+        for (cells = shape->rows[i]; cells; cells &= cells - 1)
+            blocked |= (unsigned int)game->board[row + i] >>
+                __builtin_ctz(cells);
+    }
+
+    /* the board bit of x0 is origin.x + x0 + 1, and bit 0 is a wall */
+    blocked = ~blocked & (((unsigned int)1 << (GAME_BOARD_WIDTH + 2)) - 1);
+    assert(!(blocked >> (GAME_BOARD_WIDTH + 1 - (shape->x1 - shape->x0))));
+    return (uint16_t)(ORIGIN_X_BIAS - 1 >= shape->x0 ?
+            blocked << (ORIGIN_X_BIAS - 1 - shape->x0) :
+            blocked >> (shape->x0 - ORIGIN_X_BIAS + 1));
+}
+
+/* queue up a state, unless it's been seen already */
+static void visit(struct search *search, int x, int y, int orientation,
+        degree_t canonical, int parent, input_t input, int falls)
+{
+    uint16_t column = (uint16_t)1 << (x + ORIGIN_X_BIAS);
+    struct search_state *state;
+
+    if (search->seen[canonical][y] & column)
+        return;
+    search->seen[canonical][y] |= column;
+
+    state = &search->states[search->count++];
+    state->x = x;
+    state->y = y;
+    state->orientation = orientation;
+    state->input = input;
+    state->falls = falls;
+    state->parent = parent;
+}
+
+/*
+ * The inputs that take the block to the given state, and then drop it. The
+ * fall through the open can wait for the first move down after it, since
+ * nothing is any different higher up; and the moves down at the very end
+ * are left to the drop. FAILURE if that takes too many inputs.
+ */
+static int search_path(const struct search *search, int index,
+        struct placement *placement)
+{
+    int edges = 0;
+    int falls = 0;
+    int chain[PLACEMENT_PATH_MAX];
+    const struct search_state *state;
+
+    for (; search->states[index].parent >= 0;
+            index = search->states[index].parent) {
+        if (edges == ARRAY_LEN(chain))
+            return FAILURE;
+        chain[edges++] = index;
+    }
+
+    placement->length = 0;
+    while (edges--) {
+        state = &search->states[chain[edges]];
+        if (state->falls) {
+            falls += state->falls;
+            continue;
+        }
+
+        if (state->input == INPUT_MOVE_DOWN) {
+            for (; falls; falls--) {
+                if (placement->length == PLACEMENT_PATH_MAX - 1)
+                    return FAILURE;
+                placement->path[placement->length++] = INPUT_MOVE_DOWN;
+            }
+        }
+
+        if (placement->length == PLACEMENT_PATH_MAX - 1)
+            return FAILURE;
+        placement->path[placement->length++] = state->input;
+    }
+
+    while (placement->length &&
+            placement->path[placement->length - 1] == INPUT_MOVE_DOWN)
+        placement->length--;
+    placement->path[placement->length++] = INPUT_MOVE_UP_DROP;
+
+    return SUCCESS;
+}
+
+/*
+ * List every place the current block can come to rest in, as above, into
+ * placements (room for max of them), the nearest first; returns how many
+ * there are.
+ */
+int game_reachable_placements(const struct game_state *game,
+        struct placement *placements, int max)
+{
+    int i, y, head = 0;
+    int total = 0;
+    int open = game->top_row - 5;       /* the lowest origin.y in the open */
+    const struct block *current = &game->current;
+    const struct piece_shape *shapes = piece_shapes[current->type];
+    const struct search_state *state;
+    struct placement *placement;
+    struct search search;
+
+    if (game->game_over || !game->has_current)
+        return 0;
+
+    search.count = 0;
+    memset(search.seen, 0, sizeof (search.seen));
+    visit(&search, current->origin.x, current->origin.y,
+            current->orientation, shapes[current->orientation].canonical,
+            -1, INPUT_INVALID, 0);
+
+    if (current->origin.y < open) {
+        visit(&search, current->origin.x, open, current->orientation,
+                shapes[current->orientation].canonical, 0, INPUT_INVALID,
+                open - current->origin.y);
+        head = 1;
+    }
+
+    /* nothing ever moves up, so only the rows from here down matter */
+    for (i = 0; i < piece_rotations[current->type]; i++) {
+        degree_t orientation = piece_orientations[current->type][i];
+
+        for (y = search.states[head].y; y < GAME_BOARD_HEIGHT; y++)
+            search.fits[orientation][y] =
+                fitting(game, &shapes[orientation], y);
+        search.fits[orientation][GAME_BOARD_HEIGHT] = 0;
+    }
+
+    for (; head < search.count && total < max; head++) {
+        int x, o, turned;
+        uint16_t column;
+
+        state = &search.states[head];
+        x = state->x;
+        y = state->y;
+        o = state->orientation;
+        column = (uint16_t)1 << (x + ORIGIN_X_BIAS);
+
+#define FITS(o, y, column)  (search.fits[shapes[o].canonical][y] & (column))
+
+        if (FITS(o, y, column >> 1))
+            visit(&search, x - 1, y, o, shapes[o].canonical, head,
+                    INPUT_MOVE_LEFT, 0);
+        if (FITS(o, y, column << 1))
+            visit(&search, x + 1, y, o, shapes[o].canonical, head,
+                    INPUT_MOVE_RIGHT, 0);
+
+        turned = (o + 1) % TOTAL_DEGREES;
+        if (FITS(turned, y, column))
+            visit(&search, x, y, turned, shapes[turned].canonical, head,
+                    INPUT_ROTATE_RIGHT, 0);
+        turned = (o + TOTAL_DEGREES - 1) % TOTAL_DEGREES;
+        if (FITS(turned, y, column))
+            visit(&search, x, y, turned, shapes[turned].canonical, head,
+                    INPUT_ROTATE_LEFT, 0);
+
+        /* where it can't go down any more, it comes to rest */
+        if (FITS(o, y + 1, column)) {
+            visit(&search, x, y + 1, o, shapes[o].canonical, head,
+                    INPUT_MOVE_DOWN, 0);
+        } else {
+            placement = &placements[total];
+            if (search_path(&search, head, placement) == FAILURE)
+                continue;
+
+            placement->block = *current;
+            placement->block.origin.x = x;
+            placement->block.origin.y = y;
+            placement->block.orientation = o;
+            placement->block.position = &positions[current->type][o];
+            total++;
+        }
+
+#undef FITS
+    }
+
+    return total;
+}
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
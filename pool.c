@@ -0,0 +1,259 @@
+#include "pool.h"
+
+#include "engine.h"
+
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define IDLE_SPINS          16          /* failed steals before yielding */
+
+/* the worker the calling thread is, while it is one */
+static _Thread_local struct pool_worker *self;
+
+/* the owner only: FAILURE if the deque is full */
+static int push(struct pool_deque *deque, struct pool_task *task)
+{
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+
+    if (bottom - top >= POOL_DEQUE_SIZE)
+        return FAILURE;
+
+    atomic_store_explicit(&deque->tasks[bottom % POOL_DEQUE_SIZE], task,
+            memory_order_relaxed);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_release);
+    return SUCCESS;
+}
+
+/* the owner only: the newest task, or NULL if a thief got there first */
+static struct pool_task *take(struct pool_deque *deque)
+{
+    long bottom = atomic_load_explicit(&deque->bottom,
+            memory_order_relaxed) - 1;
+    long top;
+    struct pool_task *task = NULL;
+
+    /* claim the bottom one before looking at what the thieves took */
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top <= bottom) {
+        task = atomic_load_explicit(&deque->tasks[bottom % POOL_DEQUE_SIZE],
+                memory_order_relaxed);
+        if (top != bottom)
+            return task;
+
+        /* the last one, which a thief may be after as well */
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top,
+                    top + 1, memory_order_seq_cst, memory_order_relaxed))
+            task = NULL;
+    }
+
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return task;
+}
+
+/* anyone: the oldest task, or NULL if there's none or someone beat us to it */
+static struct pool_task *steal(struct pool_deque *deque)
+{
+    long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    long bottom;
+    struct pool_task *task;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+    if (top >= bottom)
+        return NULL;
+
+    task = atomic_load_explicit(&deque->tasks[top % POOL_DEQUE_SIZE],
+            memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                memory_order_seq_cst, memory_order_relaxed))
+        return NULL;
+
+    return task;
+}
+
+/* a task off some other worker, starting with one picked at random */
+static struct pool_task *steal_any(struct pool_worker *worker)
+{
+    int i, victim;
+    struct pool *pool = worker->pool;
+    struct pool_task *task;
+
+    worker->victims ^= worker->victims << 13;
+    worker->victims ^= worker->victims >> 17;
+    worker->victims ^= worker->victims << 5;
+    victim = worker->victims % pool->threads;
+
+    for (i = 0; i < pool->threads; i++, victim = (victim + 1) % pool->threads) {
+        if (victim == worker->index)
+            continue;
+        task = steal(&pool->workers[victim].deque);
+        if (task)
+            return task;
+    }
+
+    return NULL;
+}
+
+static void run_task(struct pool_task *task)
+{
+    atomic_int *pending = task->pending;
+
+    task->run(task);
+    atomic_fetch_sub_explicit(pending, 1, memory_order_release);
+}
+
+/* after a fruitless look for work: spin a little, then let others run */
+static void idle(int *spins)
+{
+    if (++*spins >= IDLE_SPINS) {
+        *spins = 0;
+        sched_yield();
+    }
+}
+
+static void *worker_fn(void *arg)
+{
+    int spins = 0;
+    struct pool_worker *worker = (struct pool_worker *)arg;
+    struct pool *pool = worker->pool;
+    struct pool_task *task;
+
+    self = worker;
+
+    pthread_mutex_lock(&pool->lock);
+    while (!pool->quit) {
+        if (!atomic_load(&pool->busy)) {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+            continue;
+        }
+        pthread_mutex_unlock(&pool->lock);
+
+        while (atomic_load_explicit(&pool->busy, memory_order_acquire)) {
+            task = steal_any(worker);
+            if (task)
+                run_task(task);
+            else
+                idle(&spins);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    return arg;
+}
+
+/* a pool of threads workers, the caller of pool_run() included */
+int pool_init(struct pool *pool, int threads)
+{
+    int i;
+    struct pool_worker *worker;
+
+    if (threads < 1 || threads > POOL_THREADS_MAX)
+        return FAILURE;
+
+    memset(pool, 0, sizeof (*pool));
+    pool->workers = aligned_alloc(_Alignof (struct pool_worker),
+            threads * sizeof (*pool->workers));
+    if (!pool->workers)
+        return FAILURE;
+    memset(pool->workers, 0, threads * sizeof (*pool->workers));
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+
+    for (i = 0; i < threads; i++) {
+        worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i;
+        worker->victims = 2654435761u * (i + 1);
+
+        if (i && pthread_create(&worker->thread, NULL, worker_fn, worker)) {
+            pool_free(pool);
+            return FAILURE;
+        }
+        pool->threads = i + 1;          /* the ones pool_free() joins */
+    }
+
+    return SUCCESS;
+}
+
+void pool_free(struct pool *pool)
+{
+    int i;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->quit = 1;
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 1; i < pool->threads; i++)
+        pthread_join(pool->workers[i].thread, NULL);
+
+    pthread_cond_destroy(&pool->wake);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool->workers);
+    pool->workers = NULL;
+}
+
+/* run the task on the pool, returning once all of its tasks are done too */
+void pool_run(struct pool *pool, struct pool_task *task)
+{
+    self = &pool->workers[0];
+
+    if (pool->threads > 1) {
+        pthread_mutex_lock(&pool->lock);
+        atomic_store(&pool->busy, 1);
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+
+    task->run(task);
+
+    atomic_store(&pool->busy, 0);
+    self = NULL;
+}
+
+/*
+ * From a task: have the pool run another, counting it in pending until it's
+ * done (see pool_wait()). If there's no room left for it, it runs right here.
+ */
+void pool_spawn(struct pool_task *task, atomic_int *pending)
+{
+    task->pending = pending;
+    atomic_fetch_add_explicit(pending, 1, memory_order_relaxed);
+
+    if (push(&self->deque, task) == FAILURE)
+        run_task(task);
+}
+
+/* from a task: run tasks until the ones counted in pending are all done */
+void pool_wait(atomic_int *pending)
+{
+    int spins = 0;
+    struct pool_task *task;
+
+    while (atomic_load_explicit(pending, memory_order_acquire)) {
+        task = take(&self->deque);
+        if (!task && self->pool->threads > 1)
+            task = steal_any(self);
+
+        if (task)
+            run_task(task);
+        else
+            idle(&spins);
+    }
+}
+
+/* which worker of its pool the calling task runs on */
+int pool_worker_index(void)
+{
+    return self->index;
+}
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
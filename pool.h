@@ -0,0 +1,62 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+
+/*
+ * A work stealing thread pool, for searches that split up into tasks as
+ * they go and then wait for them. Every worker has a deque of tasks (the
+ * lock-free one of Chase and Lev): it pushes the tasks it spawns onto the
+ * bottom and pops them back off, the newest first, while the idle workers
+ * steal from the top, the oldest, which in a search tree is the biggest
+ * piece of work there is.
+ *
+ * The thread calling pool_run() works as worker 0 until the task it runs,
+ * and everything that task spawned, is done; the others sleep in between.
+ * A worker waiting on its tasks (pool_wait()) runs tasks meanwhile, its own
+ * or stolen ones, so no one ever sits idle while there's work to be done.
+ */
+
+#define POOL_THREADS_MAX    64
+#define POOL_DEQUE_SIZE     1024        /* beyond that, tasks run inline */
+
+struct pool_task {
+    void (*run)(struct pool_task *task);
+    atomic_int *pending;                /* counted down when it's done */
+};
+
+struct pool_deque {
+    _Alignas(64) atomic_long top;       /* where thieves steal */
+    _Alignas(64) atomic_long bottom;    /* where the owner pushes and pops */
+    _Atomic(struct pool_task *) tasks[POOL_DEQUE_SIZE];
+};
+
+struct pool_worker {
+    struct pool_deque deque;
+    struct pool *pool;
+    int index;
+    uint32_t victims;                   /* the state of who to rob next */
+    pthread_t thread;
+};
+
+struct pool {
+    int threads;
+    struct pool_worker *workers;
+    atomic_int busy;                    /* while pool_run() runs */
+    int quit;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+};
+
+int pool_init(struct pool *pool, int threads);
+void pool_free(struct pool *pool);
+void pool_run(struct pool *pool, struct pool_task *task);
+void pool_spawn(struct pool_task *task, atomic_int *pending);
+void pool_wait(atomic_int *pending);
+int pool_worker_index(void);
+
+#endif	/* __POOL_H__ */
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
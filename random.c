@@ -0,0 +1,149 @@
+#include "engine.h"
+
+#include <stddef.h>
+
+/*
+ * Per-game pseudo random numbers and block randomizers. The generator is
+ * xoshiro128** seeded through splitmix64, so a game is fully determined by
+ * its 64 bit seed on every machine, and games on different threads never
+ * share any state.
+ */
+
+#define HISTORY_ROLLS       4       /* attempts to avoid the recent blocks */
+
+static inline uint32_t rotl(uint32_t x, int k)
+{
+    return (x << k) | (x >> (32 - k));
+}
+
+static uint64_t splitmix64(uint64_t *x)
+{
+    uint64_t z = (*x += 0x9e3779b97f4a7c15ULL);
+
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void rng_seed(struct game_rng *rng, uint64_t seed)
+{
+    uint64_t a = splitmix64(&seed);
+    uint64_t b = splitmix64(&seed);
+
+    rng->s[0] = (uint32_t)a;
+    rng->s[1] = (uint32_t)(a >> 32);
+    rng->s[2] = (uint32_t)b;
+    rng->s[3] = (uint32_t)(b >> 32);
+}
+
+uint32_t rng_next(struct game_rng *rng)
+{
+    uint32_t *s = rng->s;
+    uint32_t result = rotl(s[1] * 5, 7) * 9;
+    uint32_t t = s[1] << 9;
+
+    s[2] ^= s[0];
+    s[3] ^= s[1];
+    s[1] ^= s[2];
+    s[0] ^= s[3];
+    s[2] ^= t;
+    s[3] = rotl(s[3], 11);
+
+    return result;
+}
+
+/* a number in [0, bound), by multiplying instead of the slower modulo */
+unsigned int rng_below(struct game_rng *rng, unsigned int bound)
+{
+    return (unsigned int)(((uint64_t)rng_next(rng) * bound) >> 32);
+}
+
+
+void randomizer_init(struct randomizer *randomizer, randomizer_t type,
+        uint64_t seed)
+{
+    int i;
+
+    randomizer->type = type;
+    rng_seed(&randomizer->rng, seed);
+
+    randomizer->bag_left = 0;
+
+    /* start the history off with the blocks we'd rather not begin with */
+    for (i = 0; i < ARRAY_LEN(randomizer->history); i++)
+        randomizer->history[i] = (i & 1) ? BLOCK_ZEE_2 : BLOCK_ZEE_1;
+}
+
+static block_t next_from_bag(struct randomizer *randomizer)
+{
+    int i;
+
+    if (!randomizer->bag_left) {
+        /* refill the bag with one of each block, and shuffle it */
+        for (i = 0; i < TOTAL_BLOCKS; i++)
+            randomizer->bag[i] = (block_t)i;
+
+        for (i = TOTAL_BLOCKS - 1; i > 0; i--) {
+            int j = rng_below(&randomizer->rng, i + 1);
+            block_t tmp = randomizer->bag[i];
+
+            randomizer->bag[i] = randomizer->bag[j];
+            randomizer->bag[j] = tmp;
+        }
+
+        randomizer->bag_left = TOTAL_BLOCKS;
+    }
+
+    return randomizer->bag[--randomizer->bag_left];
+}
+
+static block_t next_from_history(struct randomizer *randomizer)
+{
+    int i, roll;
+    block_t type = BLOCK_SQUARE;
+
+    /* reroll a few times while the block is one of the last few dealt */
+    for (roll = 0; roll < HISTORY_ROLLS; roll++) {
+        type = (block_t)rng_below(&randomizer->rng, TOTAL_BLOCKS);
+
+        for (i = 0; i < ARRAY_LEN(randomizer->history); i++) {
+            if (randomizer->history[i] == type)
+                break;
+        }
+
+        if (i == ARRAY_LEN(randomizer->history))
+            break;
+    }
+
+    for (i = ARRAY_LEN(randomizer->history) - 1; i > 0; i--)
+        randomizer->history[i] = randomizer->history[i - 1];
+    randomizer->history[0] = type;
+
+    return type;
+}
+
+block_t randomizer_next(struct randomizer *randomizer)
+{
+    switch (randomizer->type) {
+        case RANDOMIZER_BAG:
+            return next_from_bag(randomizer);
+        case RANDOMIZER_HISTORY:
+            return next_from_history(randomizer);
+        case RANDOMIZER_UNIFORM:
+        default:
+            return (block_t)rng_below(&randomizer->rng, TOTAL_BLOCKS);
+    }
+}
+
+const char *randomizer_name(randomizer_t type)
+{
+    static const char *names[TOTAL_RANDOMIZERS] = {
+        [RANDOMIZER_UNIFORM] = "uniform",
+        [RANDOMIZER_BAG] = "bag",
+        [RANDOMIZER_HISTORY] = "history",
+    };
+
+    return (unsigned)type < TOTAL_RANDOMIZERS ? names[type] : NULL;
+}
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
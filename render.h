@@ -0,0 +1,50 @@
+#ifndef __RENDER_H__
+#define __RENDER_H__
+
+#include "tetriz.h"
+
+/*
+ * Where the game screen goes while a game is on. graphics.c lays it out and
+ * works out what changed; a backend only puts cells and text on the areas
+ * below, and shows whatever was put since the last frame when told to. The
+ * ncurses one draws on the curses windows, the ANSI one straight on the
+ * terminal, a single write() a frame, and the null one nowhere at all.
+ *
+ * Everything else (the menus, and the banners and dialog that wait for a
+ * key) is always drawn by curses, see hand_over_to_curses() in graphics.c.
+ */
+
+typedef enum {
+    AREA_GAME,                          /* the board, 20 x 24 */
+    AREA_NEXT,                          /* the next block, 4 x 8 */
+    AREA_SCORE,                         /* the score board, 7 x 8 */
+    RENDER_AREAS,
+} area_t;
+
+/* where an area is on the screen, from its top left corner */
+struct render_area {
+    int y;
+    int x;
+};
+
+struct render_backend {
+    const char *name;
+
+    /* a game screen is up, with its areas there */
+    void (*start)(const struct render_area *areas);
+    void (*blank)(area_t area);
+    /* count blocks from cell x (each cell is two characters wide) */
+    void (*blocks)(area_t area, int y, int x, int count);
+    /* text from character x, in reverse video for the banners */
+    void (*text)(area_t area, int y, int x, int reverse, const char *text);
+    /* show everything put since the last frame */
+    void (*frame)(void);
+    /* curses is about to draw over the screen itself */
+    void (*stop)(void);
+};
+
+extern const struct render_backend ansi_backend;
+
+#endif	/* __RENDER_H__ */
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
@@ -0,0 +1,230 @@
+#include "render.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+/*
+ * The ANSI backend: every frame is put together in one buffer, made of
+ * plain VT100 sequences, and goes out in a single write(). The cursor, the
+ * character set and the video attributes are all tracked from one frame to
+ * the next, so that nothing is sent that the terminal already has, and the
+ * cursor is moved the shortest way there is. Blocks are the checkerboard of
+ * the DEC graphics set, as curses has them; that set only differs from the
+ * plain one from '_' on, so it's left on for blanks, digits and capitals.
+ */
+
+#define ANSI_BUFFER_SIZE    16384       /* a full redraw takes some 4 KB */
+
+#define ANSI_UNKNOWN        -1          /* for the tracked state */
+#define ANSI_GRAPHICS_FROM  '_'         /* what the DEC graphics set remaps */
+#define ANSI_ERASE_FROM     5           /* blanks worth an ECH, not spaces */
+
+static char buffer[ANSI_BUFFER_SIZE];
+static int length = 0;
+
+static struct render_area origins[RENDER_AREAS];
+
+static struct {
+    int y, x;                           /* the cursor, from 1 as in CUP */
+    int graphics;                       /* the DEC graphics set is on */
+    int reverse;
+} terminal = { ANSI_UNKNOWN, ANSI_UNKNOWN, ANSI_UNKNOWN, ANSI_UNKNOWN };
+
+static void flush_buffer(void)
+{
+    ssize_t written;
+    int offset = 0;
+
+    while (offset < length) {
+        written = write(STDOUT_FILENO, buffer + offset, length - offset);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            break;                      /* the terminal is gone */
+        }
+        offset += written;
+        render_stats.writes++;
+        render_stats.bytes += written;
+    }
+
+    length = 0;
+}
+
+/* make room for count more bytes; no single piece comes near the size */
+static void reserve(int count)
+{
+    if (length + count > ANSI_BUFFER_SIZE)
+        flush_buffer();
+}
+
+static void append(const char *bytes, int count)
+{
+    reserve(count);
+    while (count--)
+        buffer[length++] = *bytes++;
+}
+
+static void append_number(int number)
+{
+    char digits[12];
+    int count = 0;
+
+    do {
+        digits[count++] = '0' + number % 10;
+        number /= 10;
+    } while (number);
+
+    while (count--)
+        buffer[length++] = digits[count];
+}
+
+/* a control sequence with one parameter, left out if it's 1 */
+static void append_sequence(int parameter, char final)
+{
+    buffer[length++] = '\033';
+    buffer[length++] = '[';
+    if (parameter != 1)
+        append_number(parameter);
+    buffer[length++] = final;
+}
+
+/* the cursor to row y, column x of the screen (both from 0) */
+static void move_to(int y, int x)
+{
+    int i;
+
+    y++, x++;
+    reserve(16);
+
+    if (y == terminal.y && x == terminal.x)
+        return;
+
+    if (y == terminal.y && x > terminal.x) {
+        append_sequence(x - terminal.x, 'C');   /* CUF */
+    } else if (y == terminal.y && terminal.x - x <= 2) {
+        for (i = terminal.x; i > x; i--)
+            buffer[length++] = '\b';
+    } else if (y == terminal.y) {
+        append_sequence(x, 'G');                /* CHA */
+    } else if (x == terminal.x) {
+        append_sequence(y, 'd');                /* VPA */
+    } else {
+        buffer[length++] = '\033';
+        buffer[length++] = '[';
+        append_number(y);
+        buffer[length++] = ';';
+        append_number(x);
+        buffer[length++] = 'H';
+    }
+
+    terminal.y = y;
+    terminal.x = x;
+}
+
+static void set_graphics(int graphics)
+{
+    if (terminal.graphics != graphics)
+        append(graphics ? "\033(0" : "\033(B", 3);
+    terminal.graphics = graphics;
+}
+
+static void set_reverse(int reverse)
+{
+    if (terminal.reverse != reverse)
+        append(reverse ? "\033[1;7m" : "\033[m", reverse ? 6 : 3);
+    terminal.reverse = reverse;
+}
+
+static void ansi_start(const struct render_area *areas)
+{
+    int i;
+
+    for (i = 0; i < RENDER_AREAS; i++)
+        origins[i] = areas[i];
+}
+
+static void ansi_text(area_t area, int y, int x, int reverse,
+        const char *text)
+{
+    int count = 0;
+    int blank = !reverse;
+    int plain = 0;
+
+    for (count = 0; text[count]; count++) {
+        blank &= text[count] == ' ';
+        plain |= text[count] >= ANSI_GRAPHICS_FROM;
+    }
+
+    move_to(origins[area].y + y, origins[area].x + x);
+    set_reverse(reverse);
+
+    /* a long run of blanks is erased instead, and the cursor stays put */
+    if (blank && count >= ANSI_ERASE_FROM) {
+        reserve(8);
+        append_sequence(count, 'X');            /* ECH */
+        return;
+    }
+
+    if (plain)
+        set_graphics(0);
+    append(text, count);
+    terminal.x += count;
+}
+
+static void ansi_blocks(area_t area, int y, int x, int count)
+{
+    move_to(origins[area].y + y, origins[area].x + (x << 1));
+    set_graphics(1);
+    set_reverse(0);
+
+    count <<= 1;
+    reserve(count);
+    terminal.x += count;
+    while (count--)
+        buffer[length++] = 'a';         /* the checkerboard */
+}
+
+static void ansi_blank(area_t area)
+{
+    int y;
+    static const char *blank = "                        ";  /* the widest */
+    static const struct {
+        int height;
+        int width;
+    } sizes[RENDER_AREAS] = {
+        [AREA_GAME] = { GAME_BOARD_HEIGHT, GAME_BOARD_WIDTH << 1 },
+        [AREA_NEXT] = { 4, 8 },
+        [AREA_SCORE] = { 7, 8 },
+    };
+
+    for (y = 0; y < sizes[area].height; y++)
+        ansi_text(area, y, 0, 0, blank + (GAME_BOARD_WIDTH << 1) -
+                sizes[area].width);
+}
+
+static void ansi_frame(void)
+{
+    flush_buffer();
+}
+
+/*
+ * Leave the terminal the way curses expects it, with the plain set and no
+ * attributes; it moves the cursor about too, so the next frame places it
+ * afresh.
+ */
+static void ansi_stop(void)
+{
+    set_graphics(0);
+    set_reverse(0);
+    flush_buffer();
+
+    terminal.y = terminal.x = terminal.graphics = terminal.reverse =
+        ANSI_UNKNOWN;
+}
+
+const struct render_backend ansi_backend = {
+    "ansi", ansi_start, ansi_blank, ansi_blocks, ansi_text, ansi_frame,
+    ansi_stop,
+};
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
@@ -0,0 +1,271 @@
+#include "replay.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define REPLAY_MAGIC        "TZRP"
+#define REPLAY_EVENT_BITS   4
+#define REPLAY_EVENT_MASK   ((1 << REPLAY_EVENT_BITS) - 1)
+
+static int put_varint(uint8_t *buffer, uint64_t value)
+{
+    int length = 0;
+
+    while (value >= 0x80) {
+        buffer[length++] = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    buffer[length++] = (uint8_t)value;
+
+    return length;
+}
+
+/* returns the number of bytes used, 0 if the varint runs past the end */
+static int get_varint(const uint8_t *buffer, const uint8_t *end,
+        uint64_t *value)
+{
+    int i;
+    uint64_t result = 0;
+
+    for (i = 0; buffer + i < end && i < 10; i++) {
+        result |= (uint64_t)(buffer[i] & 0x7f) << (7 * i);
+        if (!(buffer[i] & 0x80)) {
+            *value = result;
+            return i + 1;
+        }
+    }
+
+    return 0;
+}
+
+
+void replay_init(struct replay *replay, uint64_t seed,
+        const struct game_options *options)
+{
+    memset(replay, 0, sizeof (*replay));
+    replay->seed = seed;
+    replay->options = *options;
+}
+
+void replay_free(struct replay *replay)
+{
+    free(replay->events);
+    replay->events = NULL;
+    replay->length = replay->capacity = 0;
+}
+
+int replay_record(struct replay *replay, uint64_t time_ms, int event)
+{
+    uint64_t delta = time_ms > replay->last_ms ? time_ms - replay->last_ms : 0;
+
+    /* make sure there's room for the longest possible varint */
+    if (replay->length + 10 > replay->capacity) {
+        size_t capacity = replay->capacity ? replay->capacity * 2 : 4096;
+        uint8_t *events = realloc(replay->events, capacity);
+
+        if (!events)
+            return FAILURE;
+        replay->events = events;
+        replay->capacity = capacity;
+    }
+
+    replay->length += put_varint(replay->events + replay->length,
+            (delta << REPLAY_EVENT_BITS) | (event & REPLAY_EVENT_MASK));
+    replay->last_ms += delta;
+
+    return SUCCESS;
+}
+
+void replay_finish(struct replay *replay, const struct game_score *score)
+{
+    replay->final_score = *score;
+}
+
+
+int replay_save(const struct replay *replay, const char *path)
+{
+    int i;
+    FILE *file;
+    int length = 0;
+    uint8_t header[128];
+    const struct game_score *score = &replay->final_score;
+    const int scores[] = { score->level, score->rows_cleared,
+        score->total_rows, score->score, score->current_highscore };
+
+    memcpy(header, REPLAY_MAGIC, 4);
+    length = 4;
+    header[length++] = REPLAY_VERSION;
+
+    for (i = 0; i < 8; i++)
+        header[length++] = (uint8_t)(replay->seed >> (8 * i));
+
+    header[length++] = (uint8_t)replay->options.increase_difficulty;
+    header[length++] = (uint8_t)replay->options.display_colors;
+    header[length++] = (uint8_t)replay->options.initial_level;
+    header[length++] = (uint8_t)replay->options.clear_on_new_level;
+    header[length++] = (uint8_t)replay->options.randomizer;
+
+    for (i = 0; i < ARRAY_LEN(scores); i++)
+        length += put_varint(header + length, (uint32_t)scores[i]);
+    length += put_varint(header + length, replay->length);
+
+    file = fopen(path, "wb");
+    if (!file)
+        return FAILURE;
+
+    if (fwrite(header, 1, length, file) != (size_t)length || fwrite(
+                replay->events, 1, replay->length, file) != replay->length) {
+        fclose(file);
+        return FAILURE;
+    }
+
+    return fclose(file) ? FAILURE : SUCCESS;
+}
+
+/*
+ * FAILURE if the options couldn't have come from a game: a corrupt level or
+ * randomizer would otherwise replay quietly as some other game.
+ */
+int replay_check_options(const struct game_options *options)
+{
+    if (options->initial_level < DIFFICULTY_LEVEL_MIN ||
+            options->initial_level > DIFFICULTY_LEVEL_MAX ||
+            (unsigned int)options->randomizer >= TOTAL_RANDOMIZERS)
+        return FAILURE;
+
+    return SUCCESS;
+}
+
+int replay_load(struct replay *replay, const char *path)
+{
+    int i, n;
+    long size;
+    FILE *file;
+    uint8_t *data;
+    const uint8_t *p, *end;
+    uint64_t values[6];
+
+    file = fopen(path, "rb");
+    if (!file)
+        return FAILURE;
+
+    if (fseek(file, 0, SEEK_END) || (size = ftell(file)) < 0 ||
+            fseek(file, 0, SEEK_SET)) {
+        fclose(file);
+        return FAILURE;
+    }
+
+    data = malloc(size ? size : 1);
+    if (!data || fread(data, 1, size, file) != (size_t)size) {
+        free(data);
+        fclose(file);
+        return FAILURE;
+    }
+    fclose(file);
+
+    p = data;
+    end = data + size;
+    if (size < 18 || memcmp(p, REPLAY_MAGIC, 4) || p[4] != REPLAY_VERSION)
+        goto corrupt;
+    p += 5;
+
+    memset(replay, 0, sizeof (*replay));
+    for (i = 0; i < 8; i++)
+        replay->seed |= (uint64_t)*p++ << (8 * i);
+
+    replay->options.increase_difficulty = *p++;
+    replay->options.display_colors = *p++;
+    replay->options.initial_level = *p++;
+    replay->options.clear_on_new_level = *p++;
+    replay->options.randomizer = (randomizer_t)*p++;
+    if (replay_check_options(&replay->options) == FAILURE)
+        goto corrupt;
+
+    for (i = 0; i < ARRAY_LEN(values); i++) {
+        n = get_varint(p, end, &values[i]);
+        if (!n)
+            goto corrupt;
+        p += n;
+    }
+
+    replay->final_score.level = (int)values[0];
+    replay->final_score.rows_cleared = (int)values[1];
+    replay->final_score.total_rows = (int)values[2];
+    replay->final_score.score = (int)values[3];
+    replay->final_score.current_highscore = (int)values[4];
+
+    if (values[5] != (uint64_t)(end - p))
+        goto corrupt;
+
+    /* copy the event stream out of the file buffer */
+    replay->length = replay->capacity = values[5];
+    replay->events = malloc(replay->length ? replay->length : 1);
+    if (!replay->events)
+        goto corrupt;
+    memcpy(replay->events, p, replay->length);
+    free(data);
+
+    return SUCCESS;
+
+corrupt:
+    free(data);
+    return FAILURE;
+}
+
+
+void replay_cursor_init(struct replay_cursor *cursor, const uint8_t *events,
+        size_t length)
+{
+    cursor->next = events;
+    cursor->end = events + length;
+    cursor->time_ms = 0;
+}
+
+/* fetch the next event, and advance cursor->time_ms to its timestamp */
+int replay_next(struct replay_cursor *cursor, int *event)
+{
+    uint64_t value;
+    int length = get_varint(cursor->next, cursor->end, &value);
+
+    if (!length)
+        return FAILURE;
+
+    cursor->next += length;
+    cursor->time_ms += value >> REPLAY_EVENT_BITS;
+    *event = (int)(value & REPLAY_EVENT_MASK);
+
+    return SUCCESS;
+}
+
+/* feed one recorded event to the engine, returns the gravity tick events */
+int replay_apply(struct game_state *game, int event, int *cleared_rows)
+{
+    if (event == REPLAY_EVENT_GRAVITY)
+        return game_gravity_tick(game, cleared_rows);
+
+    game_apply_input(game, (input_t)event);
+    return 0;
+}
+
+/* replay a whole event stream as fast as possible, without any rendering */
+int replay_run(const uint8_t *events, size_t length, struct game_state *game,
+        long *event_count)
+{
+    int event;
+    long count = 0;
+    struct replay_cursor cursor;
+
+    replay_cursor_init(&cursor, events, length);
+    while (replay_next(&cursor, &event) == SUCCESS) {
+        replay_apply(game, event, NULL);
+        count++;
+    }
+
+    if (event_count)
+        *event_count = count;
+
+    return cursor.next == cursor.end ? SUCCESS : FAILURE;
+}
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
@@ -0,0 +1,65 @@
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include "engine.h"
+
+#include <stddef.h>
+
+/*
+ * Compact binary replays. A replay is the seed and options of a game plus
+ * the stream of everything that was fed to the engine: inputs and gravity
+ * ticks, each stored as one varint of (milliseconds since the previous
+ * event << 4 | event code). Since the engine is deterministic, that is all
+ * it takes to reproduce the game exactly.
+ *
+ * On disk: "TZRP", a version byte, the seed (8 bytes, little endian), the
+ * options (5 bytes), the final score (5 varints), the length of the event
+ * stream (varint) and the event stream itself.
+ */
+
+#define REPLAY_VERSION      1
+
+/* event codes; the inputs use their input_t values */
+enum {
+    REPLAY_EVENT_GRAVITY    = 15,       /* game_gravity_tick() */
+};
+
+struct replay {
+    uint64_t seed;
+    struct game_options options;
+    struct game_score final_score;
+
+    uint8_t *events;            /* the encoded event stream */
+    size_t length;
+    size_t capacity;
+
+    uint64_t last_ms;           /* timestamp of the last recorded event */
+};
+
+struct replay_cursor {
+    const uint8_t *next;
+    const uint8_t *end;
+    uint64_t time_ms;
+};
+
+void replay_init(struct replay *replay, uint64_t seed,
+        const struct game_options *options);
+void replay_free(struct replay *replay);
+int replay_record(struct replay *replay, uint64_t time_ms, int event);
+void replay_finish(struct replay *replay, const struct game_score *score);
+
+int replay_save(const struct replay *replay, const char *path);
+int replay_load(struct replay *replay, const char *path);
+int replay_check_options(const struct game_options *options);
+
+void replay_cursor_init(struct replay_cursor *cursor, const uint8_t *events,
+        size_t length);
+int replay_next(struct replay_cursor *cursor, int *event);
+
+int replay_apply(struct game_state *game, int event, int *cleared_rows);
+int replay_run(const uint8_t *events, size_t length, struct game_state *game,
+        long *event_count);
+
+#endif	/* __REPLAY_H__ */
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
@@ -0,0 +1,611 @@
+#include "engine.h"
+#include "bot.h"
+#include "expectimax.h"
+#include <pthread.h>
+
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * tetriz-sim: plays games to completion with the headless engine, spread
+ * over a number of threads, and prints aggregate statistics at the end.
+ * Every thread owns its engine instances, and plays a contiguous range of
+ * the games, writing their results into its own stretch of the results; so
+ * the threads share nothing but the inputs, and the odd cache line where
+ * two stretches meet.
+ */
+
+#define DEFAULT_GAMES       1000
+
+struct game_result {
+    long pieces;
+    int lines;
+    int score;
+};
+
+/* what a policy plays with on one thread, set up before its first game */
+struct player {
+    struct game_rng rng;        /* reseeded for every game */
+    struct beam *beam;
+    struct expectimax *search;
+    uint64_t nodes;             /* searched, as of the teardown */
+};
+
+struct sim_config;
+
+struct policy {
+    const char *name;
+    const char *description;
+    void (*play)(struct game_state *game, struct player *player);
+    int (*setup)(struct player *player, const struct sim_config *config);
+    void (*teardown)(struct player *player);    /* NULL, with no setup */
+};
+
+struct sim_config {
+    uint64_t first_seed;
+    int games;
+    int threads;
+    long max_pieces;            /* 0 for no limit */
+    const struct policy *policy;
+    struct game_options options;
+    int beam_width;
+    int search_threads;         /* per game, for expectimax */
+    int sweep_threads;          /* sweep 1 .. this many, 0 for no sweep */
+};
+
+struct sim_thread {
+    pthread_t thread_id;
+    int index;
+    const struct sim_config *config;
+    struct game_result *results;
+    struct player player;
+    int failed;                 /* the policy couldn't be set up */
+};
+
+static void policy_drop(struct game_state *game, struct player *player);
+static void policy_random(struct game_state *game, struct player *player);
+static void policy_heuristic(struct game_state *game, struct player *player);
+static void policy_beam(struct game_state *game, struct player *player);
+static int setup_beam(struct player *player, const struct sim_config *config);
+static void teardown_beam(struct player *player);
+static void policy_expectimax(struct game_state *game,
+        struct player *player);
+static int setup_expectimax(struct player *player,
+        const struct sim_config *config);
+static void teardown_expectimax(struct player *player);
+
+static const struct policy policies[] = {
+    { "drop", "drop every block where it appears", policy_drop, NULL,
+        NULL },
+    { "random", "random rotation and column, then drop", policy_random,
+        NULL, NULL },
+    { "heuristic", "the placement the bot scores best (see bot.h)",
+        policy_heuristic, NULL, NULL },
+    { "beam", "the bot looking ahead to the next block (see bot.h)",
+        policy_beam, setup_beam, teardown_beam },
+    { "expectimax", "the bot playing the odds of the blocks to come "
+        "(see expectimax.h)", policy_expectimax, setup_expectimax,
+        teardown_expectimax },
+};
+
+static const char *prog_name = NULL;
+
+
+static void policy_drop(struct game_state *game, struct player *player)
+{
+    (void)player;
+    game_apply_input(game, INPUT_MOVE_UP_DROP);
+}
+
+static void policy_random(struct game_state *game, struct player *player)
+{
+    int i;
+    int rotations = rng_below(&player->rng, TOTAL_DEGREES);
+    int shift = (int)rng_below(&player->rng, GAME_BOARD_WIDTH) -
+        GAME_BOARD_WIDTH / 2;
+
+    for (i = 0; i < rotations; i++)
+        game_apply_input(game, INPUT_ROTATE_RIGHT);
+
+    for (i = 0; i < abs(shift); i++)
+        game_apply_input(game,
+                shift < 0 ? INPUT_MOVE_LEFT : INPUT_MOVE_RIGHT);
+
+    game_apply_input(game, INPUT_MOVE_UP_DROP);
+}
+
+/* play the path to the bot's pick, just as the keys would */
+static void play_placement(struct game_state *game,
+        const struct placement *placement)
+{
+    int i;
+
+    for (i = 0; i < placement->length; i++)
+        game_apply_input(game, placement->path[i]);
+}
+
+static void policy_heuristic(struct game_state *game, struct player *player)
+{
+    struct placement placement;
+
+    (void)player;
+    if (bot_choose(game, &bot_default_weights, &placement) == SUCCESS)
+        play_placement(game, &placement);
+}
+
+static void policy_beam(struct game_state *game, struct player *player)
+{
+    struct placement placement;
+
+    if (beam_choose(player->beam, game, &bot_default_weights,
+                beam_budget(game), &placement) == SUCCESS)
+        play_placement(game, &placement);
+}
+
+/* the beam is reused for every block the thread plays */
+static int setup_beam(struct player *player, const struct sim_config *config)
+{
+    player->beam = malloc(sizeof (*player->beam));
+    if (!player->beam)
+        return FAILURE;
+
+    beam_init(player->beam, config->beam_width);
+    return SUCCESS;
+}
+
+static void teardown_beam(struct player *player)
+{
+    free(player->beam);
+    player->beam = NULL;
+}
+
+static void policy_expectimax(struct game_state *game, struct player *player)
+{
+    struct placement placement;
+
+    if (expectimax_choose(player->search, game, &bot_default_weights,
+                &placement) == SUCCESS)
+        play_placement(game, &placement);
+}
+
+/* and so is the search, with its pool of threads and its table */
+static int setup_expectimax(struct player *player,
+        const struct sim_config *config)
+{
+    player->search = aligned_alloc(_Alignof (struct expectimax),
+            sizeof (*player->search));
+    if (!player->search)
+        return FAILURE;
+
+    if (expectimax_init(player->search, config->search_threads,
+                EXPECTIMAX_DEFAULT_WIDTH, EXPECTIMAX_DEFAULT_DEPTH)) {
+        free(player->search);
+        player->search = NULL;
+        return FAILURE;
+    }
+
+    return SUCCESS;
+}
+
+static void teardown_expectimax(struct player *player)
+{
+    player->nodes = expectimax_nodes(player->search);
+    expectimax_free(player->search);
+    free(player->search);
+    player->search = NULL;
+}
+
+
+static void play_one_game(const struct sim_config *config,
+        struct player *player, uint64_t seed, struct game_result *result)
+{
+    int events;
+    struct game_state game;
+
+    game_init(&game, &config->options, 0, seed);
+    rng_seed(&player->rng, ~seed);    /* independent of the block stream */
+    result->pieces = 0;
+
+    while (1) {
+        events = game_gravity_tick(&game, NULL);
+        if (events & GAME_EVENT_GAME_OVER)
+            break;
+
+        if (events & GAME_EVENT_SPAWNED) {
+            if (config->max_pieces && result->pieces >= config->max_pieces)
+                break;
+
+            result->pieces++;
+            config->policy->play(&game, player);
+        }
+    }
+
+    result->lines = game.score.total_rows;
+    result->score = game.score.score;
+}
+
+static void *sim_thread_fn(void *arg)
+{
+    int i, first, last;
+    struct sim_thread *thread = (struct sim_thread *)arg;
+    const struct sim_config *config = thread->config;
+
+    first = (int)((long long)thread->index * config->games / config->threads);
+    last = (int)((long long)(thread->index + 1) * config->games /
+            config->threads);
+
+    if (config->policy->setup &&
+            config->policy->setup(&thread->player, config) == FAILURE) {
+        thread->failed = 1;
+        return arg;
+    }
+
+    for (i = first; i < last; i++)
+        play_one_game(config, &thread->player, config->first_seed + i,
+                &thread->results[i]);
+
+    if (config->policy->teardown)
+        config->policy->teardown(&thread->player);
+
+    return arg;
+}
+
+
+static double elapsed_seconds(const struct timespec *start)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+static int compare_ints(const void *a, const void *b)
+{
+    int x = *(const int *)a;
+    int y = *(const int *)b;
+
+    return (x > y) - (x < y);
+}
+
+static void print_stats(const struct sim_config *config,
+        const struct game_result *results, uint64_t nodes, double seconds)
+{
+    int i;
+    long pieces = 0;
+    long long lines = 0;
+    long long total_score = 0;
+    int *scores;
+    static const int percentiles[] = { 10, 25, 50, 75, 90, 99 };
+
+    scores = malloc(config->games * sizeof (*scores));
+    if (!scores) {
+        fprintf(stderr, "%s: out of memory\n", prog_name);
+        return;
+    }
+
+    for (i = 0; i < config->games; i++) {
+        pieces += results[i].pieces;
+        lines += results[i].lines;
+        total_score += results[i].score;
+        scores[i] = results[i].score;
+    }
+
+    qsort(scores, config->games, sizeof (*scores), compare_ints);
+
+    printf("policy       : %s\n", config->policy->name);
+    printf("seeds        : %llu..%llu\n",
+            (unsigned long long)config->first_seed,
+            (unsigned long long)(config->first_seed + config->games - 1));
+    printf("randomizer   : %s\n",
+            randomizer_name(config->options.randomizer));
+    printf("threads      : %d\n", config->threads);
+    printf("elapsed      : %.3f s\n", seconds);
+    printf("games/sec    : %.1f\n", config->games / seconds);
+    printf("pieces/sec   : %.1f\n", pieces / seconds);
+    if (nodes) {
+        printf("search thr.  : %d\n", config->search_threads);
+        printf("nodes/sec    : %.1f\n", nodes / seconds);
+    }
+    printf("mean pieces  : %.2f\n", (double)pieces / config->games);
+    printf("mean lines   : %.2f\n", (double)lines / config->games);
+    printf("mean score   : %.2f\n", (double)total_score / config->games);
+    printf("score min    : %d\n", scores[0]);
+    for (i = 0; i < ARRAY_LEN(percentiles); i++) {
+        printf("score p%-2d    : %d\n", percentiles[i],
+                scores[(config->games - 1) * percentiles[i] / 100]);
+    }
+    printf("score max    : %d\n", scores[config->games - 1]);
+
+    free(scores);
+}
+
+
+static void usage(void)
+{
+    int i;
+
+    fprintf(stderr,
+            "usage: %s [-s first-seed] [-n games] [-p policy] [-j threads]\n"
+            "          [-l level] [-m max-pieces] [-r randomizer]"
+            " [-k beam-width]\n"
+            "          [-t search-threads] [-T max-search-threads]\n\n"
+            "Plays the games with seeds first-seed .. first-seed + games - 1"
+            " (default %d games)\nand prints aggregate statistics. "
+            "Policies:\n", prog_name, DEFAULT_GAMES);
+
+    for (i = 0; i < ARRAY_LEN(policies); i++)
+        fprintf(stderr, "    %-10s %s\n", policies[i].name,
+                policies[i].description);
+
+    fprintf(stderr, "Randomizers:\n   ");
+    for (i = 0; i < TOTAL_RANDOMIZERS; i++)
+        fprintf(stderr, " %s", randomizer_name(i));
+    fprintf(stderr, "\n");
+}
+
+static int find_randomizer(const char *name)
+{
+    int i;
+
+    for (i = 0; i < TOTAL_RANDOMIZERS; i++) {
+        if (strcmp(randomizer_name(i), name) == 0)
+            return i;
+    }
+
+    return -1;
+}
+
+static const struct policy *find_policy(const char *name)
+{
+    int i;
+
+    for (i = 0; i < ARRAY_LEN(policies); i++) {
+        if (strcmp(policies[i].name, name) == 0)
+            return &policies[i];
+    }
+
+    return NULL;
+}
+
+static int parse_command_line_arguments(int argc, char **argv,
+        struct sim_config *config)
+{
+    int opt;
+
+    while ((opt = getopt(argc, argv, "s:n:p:j:l:m:r:k:t:T:h")) != -1) {
+        switch (opt) {
+            case 's':
+                config->first_seed = strtoull(optarg, NULL, 0);
+                break;
+            case 'n':
+                config->games = atoi(optarg);
+                break;
+            case 'p':
+                config->policy = find_policy(optarg);
+                if (!config->policy) {
+                    fprintf(stderr, "%s: unknown policy '%s'\n",
+                            prog_name, optarg);
+                    return FAILURE;
+                }
+                break;
+            case 'j':
+                config->threads = atoi(optarg);
+                break;
+            case 'l':
+                config->options.initial_level = atoi(optarg);
+                break;
+            case 'm':
+                config->max_pieces = atol(optarg);
+                break;
+            case 'k':
+                config->beam_width = atoi(optarg);
+                break;
+            case 't':
+                config->search_threads = atoi(optarg);
+                break;
+            case 'T':
+                config->sweep_threads = atoi(optarg);
+                break;
+            case 'r':
+                if (find_randomizer(optarg) < 0) {
+                    fprintf(stderr, "%s: unknown randomizer '%s'\n",
+                            prog_name, optarg);
+                    return FAILURE;
+                }
+                config->options.randomizer = find_randomizer(optarg);
+                break;
+            default:
+                usage();
+                return FAILURE;
+        }
+    }
+
+    if (optind != argc || config->games <= 0 || config->threads <= 0 ||
+            config->max_pieces < 0 || config->beam_width < 1 ||
+            config->beam_width > BEAM_WIDTH_MAX ||
+            config->search_threads < 1 ||
+            config->search_threads > POOL_THREADS_MAX ||
+            config->sweep_threads < 0 ||
+            config->sweep_threads > POOL_THREADS_MAX ||
+            (config->sweep_threads &&
+                config->policy->setup != setup_expectimax) ||
+            config->options.initial_level < DIFFICULTY_LEVEL_MIN ||
+            config->options.initial_level > DIFFICULTY_LEVEL_MAX) {
+        usage();
+        return FAILURE;
+    }
+
+    if (config->threads > config->games)
+        config->threads = config->games;
+
+    return SUCCESS;
+}
+
+
+/*
+ * Play all the games, spread over config->threads threads, into results;
+ * FAILURE if the threads can't be had or the policy can't be set up.
+ */
+static int run_games(const struct sim_config *config,
+        struct game_result *results, uint64_t *nodes, double *seconds)
+{
+    int i;
+    int status = SUCCESS;
+    struct timespec start;
+    struct sim_thread *threads;
+
+    threads = calloc(config->threads, sizeof (*threads));
+    if (!threads) {
+        fprintf(stderr, "%s: out of memory\n", prog_name);
+        return FAILURE;
+    }
+
+    *nodes = 0;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i < config->threads; i++) {
+        threads[i].index = i;
+        threads[i].config = config;
+        threads[i].results = results;
+
+        if (pthread_create(&threads[i].thread_id, NULL, sim_thread_fn,
+                    (void *)&threads[i])) {
+            fprintf(stderr, "%s: failed to create thread %d\n", prog_name, i);
+            status = FAILURE;
+            break;
+        }
+    }
+
+    while (i--) {
+        pthread_join(threads[i].thread_id, NULL);
+        *nodes += threads[i].player.nodes;
+        if (threads[i].failed) {
+            fprintf(stderr, "%s: failed to set up the '%s' policy\n",
+                    prog_name, config->policy->name);
+            status = FAILURE;
+        }
+    }
+
+    *seconds = elapsed_seconds(&start);
+    free(threads);
+    return status;
+}
+
+/* 1 if the two runs played every game the same way, as far as it shows */
+static int same_games(const struct game_result *a, const struct game_result *b,
+        int games)
+{
+    int i;
+
+    for (i = 0; i < games; i++) {
+        if (a[i].score != b[i].score || a[i].lines != b[i].lines ||
+                a[i].pieces != b[i].pieces)
+            return 0;
+    }
+    return 1;
+}
+
+/*
+ * Play the same games with 1, 2, 4, ... search threads, up to
+ * config->sweep_threads, one game at a time so that nothing but the search
+ * competes for the cores, and print how long each took next to one thread.
+ * The games must come out the same every time, as the search doesn't depend
+ * on its threads, so the time is what counts: nodes searched twice by
+ * threads racing for the table make for more nodes/sec, but not sooner.
+ */
+static int sweep(struct sim_config *config, struct game_result *results)
+{
+    int threads;
+    int status = SUCCESS;
+    uint64_t nodes;
+    double seconds, speedup, first_seconds = 0;
+    struct game_result *first;
+
+    first = malloc(config->games * sizeof (*first));
+    if (!first) {
+        fprintf(stderr, "%s: out of memory\n", prog_name);
+        return FAILURE;
+    }
+
+    config->threads = 1;
+
+    printf("policy       : %s\n", config->policy->name);
+    printf("seeds        : %llu..%llu\n",
+            (unsigned long long)config->first_seed,
+            (unsigned long long)(config->first_seed + config->games - 1));
+    printf("cpus         : %ld\n", sysconf(_SC_NPROCESSORS_ONLN));
+    printf("\nthreads   elapsed   speedup  efficiency     nodes/sec\n");
+
+    for (threads = 1; ; threads = threads * 2 < config->sweep_threads ?
+            threads * 2 : config->sweep_threads) {
+        config->search_threads = threads;
+        if (run_games(config, results, &nodes, &seconds) == FAILURE) {
+            status = FAILURE;
+            break;
+        }
+
+        if (threads == 1) {
+            first_seconds = seconds;
+            memcpy(first, results, config->games * sizeof (*first));
+        }
+
+        speedup = first_seconds / seconds;
+        printf("%7d %7.3f s %8.2fx %10.1f%% %13.1f%s\n", threads, seconds,
+                speedup, 100 * speedup / threads, nodes / seconds,
+                same_games(first, results, config->games) ? "" :
+                "  (games differ!)");
+        fflush(stdout);
+
+        if (threads == config->sweep_threads)
+            break;
+    }
+
+    free(first);
+    return status;
+}
+
+
+int main(int argc, char **argv)
+{
+    int status;
+    long cpus;
+    uint64_t nodes;
+    double seconds;
+    struct game_result *results;
+    struct sim_config config = {
+        1, DEFAULT_GAMES, 1, 0, &policies[1],
+        { 1, 0, 1, 0, RANDOMIZER_UNIFORM },     /* the game's defaults */
+        BEAM_DEFAULT_WIDTH, 1, 0,
+    };
+
+    prog_name = strrchr(*argv, '/');
+    prog_name = prog_name ? (prog_name + 1) : *argv;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    config.threads = cpus > 0 ? (int)cpus : 1;
+
+    if (parse_command_line_arguments(argc, argv, &config))
+        return FAILURE;
+
+    results = calloc(config.games, sizeof (*results));
+    if (!results) {
+        fprintf(stderr, "%s: out of memory\n", prog_name);
+        return FAILURE;
+    }
+
+    if (config.sweep_threads) {
+        status = sweep(&config, results);
+    } else {
+        status = run_games(&config, results, &nodes, &seconds);
+        if (status == SUCCESS)
+            print_stats(&config, results, nodes, seconds);
+    }
+
+    free(results);
+    return status;
+}
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
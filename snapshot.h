@@ -0,0 +1,86 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "engine.h"
+
+#include <stdatomic.h>
+
+/*
+ * Snapshots of a game as the screen shows it, handed from the thread that
+ * plays the game to the one that draws it without either ever waiting for
+ * the other. There are three slots: the writer fills its own, then swaps it
+ * with the published one in a single atomic exchange, and the reader swaps
+ * its own with the published one whenever that is newer. Every snapshot the
+ * reader takes is thus complete and stays untouched while it is drawn, and
+ * when the writer is quicker than the reader, the snapshots in between are
+ * simply skipped.
+ */
+
+struct game_snapshot {
+    row_t rows[GAME_BOARD_HEIGHT];      /* see game_render_rows() */
+    block_t next_block;
+    degree_t next_block_orientation;
+    struct game_score score;
+    uint64_t inputs;                    /* applied since the game started */
+
+    /*
+     * for a snapshot taken right after rows were cleared, the board as it
+     * was just before, and which rows those were
+     */
+    int events;                         /* GAME_EVENT_ROWS_CLEARED etc. */
+    row_t locked_rows[GAME_BOARD_HEIGHT];
+    int cleared_rows[GAME_BOARD_HEIGHT];
+    int cleared_count;
+};
+
+#define SNAPSHOT_FRESH      4           /* flags a slot not read yet */
+
+struct snapshot_buffer {
+    struct game_snapshot slots[3];
+    atomic_uint published;              /* slot index, | SNAPSHOT_FRESH */
+    unsigned int writing;               /* owned by the writer */
+    unsigned int reading;               /* owned by the reader */
+};
+
+static inline void snapshot_buffer_init(struct snapshot_buffer *buffer)
+{
+    buffer->writing = 0;
+    atomic_init(&buffer->published, 1);
+    buffer->reading = 2;
+}
+
+/* the writer's slot, to be filled in before snapshot_publish() */
+static inline struct game_snapshot *snapshot_slot(
+        struct snapshot_buffer *buffer)
+{
+    return &buffer->slots[buffer->writing];
+}
+
+static inline void snapshot_publish(struct snapshot_buffer *buffer)
+{
+    unsigned int old = atomic_exchange_explicit(&buffer->published,
+            buffer->writing | SNAPSHOT_FRESH, memory_order_acq_rel);
+
+    buffer->writing = old & ~SNAPSHOT_FRESH;
+}
+
+/* the latest snapshot, or NULL if nothing was published since the last one */
+static inline const struct game_snapshot *snapshot_take(
+        struct snapshot_buffer *buffer)
+{
+    unsigned int old;
+
+    if (!(atomic_load_explicit(&buffer->published, memory_order_relaxed) &
+                SNAPSHOT_FRESH))
+        return NULL;
+
+    old = atomic_exchange_explicit(&buffer->published, buffer->reading,
+            memory_order_acq_rel);
+    buffer->reading = old & ~SNAPSHOT_FRESH;
+
+    return &buffer->slots[buffer->reading];
+}
+
+#endif	/* __SNAPSHOT_H__ */
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
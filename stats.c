@@ -0,0 +1,204 @@
+#include "stats.h"
+
+#ifdef TETRIZ_STATS
+
+#include "engine.h"
+
+#include <string.h>
+
+#define STATS_THREADS       8           /* kinds of threads, not threads */
+
+_Thread_local struct thread_stats thread_stats;
+
+static const char *phase_names[PHASES] = { "logic", "render", "animation" };
+
+/* the totals of every thread done so far, by its name */
+static struct {
+    const char *name;
+    struct engine_stats engine;
+    struct thread_stats thread;
+} totals[STATS_THREADS];
+
+static int total_count = 0;
+static pthread_mutex_t totals_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* to tell how many cycles make a us, from start to dump */
+static uint64_t start_cycles;
+static struct timespec start_time;
+
+void stats_init(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    start_cycles = stats_cycles();
+}
+
+void stats_lock(pthread_mutex_t *mutex)
+{
+    struct lock_stats *stats = &thread_stats.lock;
+    uint64_t start = stats_cycles();
+    uint64_t wait;
+
+    pthread_mutex_lock(mutex);
+    stats->locked = stats_cycles();
+
+    wait = stats->locked - start;
+    stats->acquired++;
+    stats->wait += wait;
+    if (wait > stats->max_wait)
+        stats->max_wait = wait;
+}
+
+void stats_unlock(pthread_mutex_t *mutex)
+{
+    struct lock_stats *stats = &thread_stats.lock;
+    uint64_t hold = stats_cycles() - stats->locked;
+
+    pthread_mutex_unlock(mutex);
+
+    stats->hold += hold;
+    if (hold > stats->max_hold)
+        stats->max_hold = hold;
+}
+
+static void add_up(uint64_t *total, const uint64_t *counters, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++)
+        total[i] += counters[i];
+}
+
+static void add_phase(struct phase_stats *total,
+        const struct phase_stats *stats)
+{
+    total->count += stats->count;
+    total->cycles += stats->cycles;
+    if (stats->max > total->max)
+        total->max = stats->max;
+}
+
+static void add_lock(struct lock_stats *total, const struct lock_stats *stats)
+{
+    total->acquired += stats->acquired;
+    total->wait += stats->wait;
+    total->hold += stats->hold;
+    if (stats->max_wait > total->max_wait)
+        total->max_wait = stats->max_wait;
+    if (stats->max_hold > total->max_hold)
+        total->max_hold = stats->max_hold;
+}
+
+/*
+ * Add what the calling thread counted to the totals for its kind, and start
+ * it over; a thread that goes on to do something else can then be counted
+ * under another name.
+ */
+void stats_thread_done(const char *name)
+{
+    int i, phase;
+    const struct engine_stats *engine = &engine_stats;
+
+    pthread_mutex_lock(&totals_lock);
+
+    for (i = 0; i < total_count && strcmp(totals[i].name, name); i++)
+        ;
+    if (i == total_count && total_count < STATS_THREADS)
+        totals[total_count++].name = name;
+
+    if (i < total_count) {
+        add_up(totals[i].engine.moves, engine->moves, ENGINE_ACTIONS);
+        totals[i].engine.tests += engine->tests;
+        totals[i].engine.rejected += engine->rejected;
+        totals[i].engine.freezes += engine->freezes;
+        add_up(totals[i].engine.clears, engine->clears,
+                ENGINE_MAX_CLEARED + 1);
+
+        for (phase = 0; phase < PHASES; phase++)
+            add_phase(&totals[i].thread.phases[phase],
+                    &thread_stats.phases[phase]);
+        add_lock(&totals[i].thread.lock, &thread_stats.lock);
+    }
+
+    pthread_mutex_unlock(&totals_lock);
+
+    memset(&engine_stats, 0, sizeof (engine_stats));
+    memset(&thread_stats, 0, sizeof (thread_stats));
+}
+
+static void dump_thread(FILE *file, const char *name,
+        const struct engine_stats *engine, const struct thread_stats *thread)
+{
+    int i;
+    const struct lock_stats *lock = &thread->lock;
+
+    fprintf(file, "{\"thread\":\"%s\",\"move_block\":{", name);
+    for (i = 0; i < ENGINE_ACTIONS; i++)
+        fprintf(file, "%s\"%s\":%llu", i ? "," : "", engine_action_names[i],
+                (unsigned long long)engine->moves[i]);
+
+    fprintf(file, "},\"test_movement\":{\"calls\":%llu,\"rejected\":%llu},"
+            "\"freeze_block\":%llu,\"clear_even_rows\":[",
+            (unsigned long long)engine->tests,
+            (unsigned long long)engine->rejected,
+            (unsigned long long)engine->freezes);
+    for (i = 0; i <= ENGINE_MAX_CLEARED; i++)
+        fprintf(file, "%s%llu", i ? "," : "",
+                (unsigned long long)engine->clears[i]);
+
+    fprintf(file, "],\"screen_lock\":{\"acquired\":%llu,\"wait\":%llu,"
+            "\"hold\":%llu,\"max_wait\":%llu,\"max_hold\":%llu},"
+            "\"phases\":{", (unsigned long long)lock->acquired,
+            (unsigned long long)lock->wait, (unsigned long long)lock->hold,
+            (unsigned long long)lock->max_wait,
+            (unsigned long long)lock->max_hold);
+    for (i = 0; i < PHASES; i++)
+        fprintf(file, "%s\"%s\":{\"count\":%llu,\"cycles\":%llu,"
+                "\"max\":%llu}", i ? "," : "", phase_names[i],
+                (unsigned long long)thread->phases[i].count,
+                (unsigned long long)thread->phases[i].cycles,
+                (unsigned long long)thread->phases[i].max);
+    fputs("}}\n", file);
+}
+
+/*
+ * One line for the clock the cycles were counted with, then one for each
+ * kind of thread; whatever the calling thread itself counted and didn't hand
+ * in yet goes in as "main".
+ */
+void stats_dump(FILE *file)
+{
+    int i;
+    struct timespec now;
+    uint64_t cycles = stats_cycles() - start_cycles;
+    double us;
+    static const struct engine_stats no_engine_stats;
+    static const struct thread_stats no_thread_stats;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    us = (now.tv_sec - start_time.tv_sec) * 1e6 +
+        (now.tv_nsec - start_time.tv_nsec) / 1e3;
+
+    if (memcmp(&engine_stats, &no_engine_stats, sizeof (engine_stats)) ||
+            memcmp(&thread_stats, &no_thread_stats, sizeof (thread_stats)))
+        stats_thread_done("main");
+
+    fprintf(file, "{\"clock\":\"%s\",\"cycles_per_us\":%.1f}\n",
+#if defined(__x86_64__) || defined(__i386__)
+            "tsc",
+#else
+            "ns",
+#endif
+            us > 0 ? cycles / us : 0.0);
+
+    pthread_mutex_lock(&totals_lock);
+    for (i = 0; i < total_count; i++)
+        dump_thread(file, totals[i].name, &totals[i].engine,
+                &totals[i].thread);
+    pthread_mutex_unlock(&totals_lock);
+
+    fflush(file);
+}
+
+#endif	/* TETRIZ_STATS */
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
@@ -0,0 +1,101 @@
+#ifndef __STATS_H__
+#define __STATS_H__
+
+/*
+ * Counters and timers for working out where the time goes, built in with
+ * -DTETRIZ_STATS (see the Makefile). Besides what the engine counts (see
+ * struct engine_stats), every thread times the phases it runs, in cycles,
+ * and the waits for the screen lock and how long it holds it. All of it is
+ * kept per thread, and handed in with stats_thread_done() once a thread is
+ * done; the totals for each kind of thread are written out on exit, one
+ * JSON object a line.
+ *
+ * Without TETRIZ_STATS, none of this is compiled in: the timers are empty
+ * macros, and stats_lock() is just pthread_mutex_lock().
+ */
+
+#include <pthread.h>
+
+typedef enum {
+    PHASE_LOGIC,                        /* applying inputs and gravity */
+    PHASE_RENDER,                       /* drawing a snapshot, or a tick */
+    PHASE_ANIMATION,                    /* stepping the clear effects */
+    PHASES,
+} phase_t;
+
+#ifdef TETRIZ_STATS
+
+#include <stdio.h>
+#include <stdint.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+struct phase_stats {
+    uint64_t count;
+    uint64_t cycles;
+    uint64_t max;
+};
+
+struct lock_stats {
+    uint64_t acquired;
+    uint64_t wait;                      /* cycles spent waiting for it */
+    uint64_t hold;                      /* ... and holding it */
+    uint64_t max_wait;
+    uint64_t max_hold;
+    uint64_t locked;                    /* when it was last acquired */
+};
+
+struct thread_stats {
+    struct phase_stats phases[PHASES];
+    struct lock_stats lock;
+};
+
+extern _Thread_local struct thread_stats thread_stats;
+
+/* the time stamp counter, or the ns of the monotonic clock without one */
+static inline uint64_t stats_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+#define phase_begin()       stats_cycles()
+
+static inline void phase_end(phase_t phase, uint64_t start)
+{
+    struct phase_stats *stats = &thread_stats.phases[phase];
+    uint64_t cycles = stats_cycles() - start;
+
+    stats->count++;
+    stats->cycles += cycles;
+    if (cycles > stats->max)
+        stats->max = cycles;
+}
+
+void stats_init(void);
+void stats_lock(pthread_mutex_t *mutex);
+void stats_unlock(pthread_mutex_t *mutex);
+void stats_thread_done(const char *name);
+void stats_dump(FILE *file);
+
+#else
+
+#define phase_begin()               0
+#define phase_end(phase, start)     ((void)(phase), (void)(start))
+#define stats_lock(mutex)           pthread_mutex_lock(mutex)
+#define stats_unlock(mutex)         pthread_mutex_unlock(mutex)
+#define stats_thread_done(name)     ((void)0)
+
+#endif	/* TETRIZ_STATS */
+
+#endif	/* __STATS_H__ */
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
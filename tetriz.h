@@ -1,98 +1,69 @@
 #ifndef __TETRIZ_H__
 #define __TETRIZ_H__
 
+#include "engine.h"
+
 #define GAME_VERSION    "0.9"
 
 #define WINDOW_MAIN_SIZE_X	80
 #define WINDOW_MAIN_SIZE_Y	24
 
-#define DIFFICULTY_LEVEL_MIN	1
-#define DIFFICULTY_LEVEL_MAX	25
-
 #define KEY_ESCAPE		27
 
-#define GAME_BOARD_HEIGHT		20
-#define GAME_BOARD_WIDTH		12
-
-#define ARRAY_LEN(arr)	((int)(sizeof (arr) / sizeof (*(arr))))
-
-enum { SUCCESS, FAILURE };
-
-typedef enum {
-    BLOCK_SQUARE,
-    BLOCK_LINE,
-    BLOCK_TEE,
-    BLOCK_ZEE_1,
-    BLOCK_ZEE_2,
-    BLOCK_ELL_1,
-    BLOCK_ELL_2,
-
-    TOTAL_BLOCKS,
-} block_t;
-
-typedef enum {
-    DEG_0,
-    DEG_90,
-    DEG_180,
-    DEG_270,
-    TOTAL_DEGREES
-} degree_t;
-
-struct point {
-    int x;
-    int y;
+extern const char *prog_name;	/* the name the program was invoked with */
+extern const char *record_path;
+extern int record_failed;
+extern int event_loop;
+extern int show_input_stats;
+extern int raw_input;
+
+/* how many inputs each frame drawn took in, see --input-stats */
+struct input_stats {
+    uint64_t frames;                    /* the frames with any input at all */
+    uint64_t inputs;
+    int max;                            /* the most in one frame */
 };
 
-struct position {
-    struct point pos[4];
-};
+extern struct input_stats input_stats;
 
-struct block {
-    block_t type;
-    struct point origin;
-    degree_t orientation;
-    int color;
-    const struct position *position;
+/* what went to the terminal while games were drawn, see --render-stats */
+struct render_stats {
+    uint64_t frames;
+    uint64_t writes;                    /* write() calls, where counted */
+    uint64_t bytes;
 };
 
-struct game_options {
-    int increase_difficulty;
-    int display_colors;
-    int initial_level;
-    int clear_on_new_level;
-};
+extern struct render_stats render_stats;
 
-struct game_score {
+typedef enum {
+    ANIMATION_CLEARED_ROWS_1,
+    ANIMATION_CLEARED_ROWS_2,
+    ANIMATION_CLEARED_ROWS_3,
+    ANIMATION_LEVEL_INFO,
+} animation_t;
+
+/* an animation in progress, see animation_update() */
+struct animation {
+    animation_t type;
+    int step;                           /* the next one to draw */
+    int direction;
     int level;
-    int rows_cleared;
-    int total_rows;
-    int score;
-    int current_highscore;
+    int count;
+    int rows[GAME_BOARD_HEIGHT];
 };
 
-typedef enum {
-    INPUT_TIMEOUT,
-    INPUT_INVALID,
-    INPUT_MOVE_LEFT,
-    INPUT_MOVE_RIGHT,
-    INPUT_MOVE_DOWN,
-    INPUT_MOVE_UP_DROP,
-    INPUT_ROTATE_LEFT,
-    INPUT_ROTATE_RIGHT,
-    INPUT_PAUSE_QUIT,
-} input_t;
-
-extern const char *prog_name;	/* the name the program was invoked with */
-extern int board[GAME_BOARD_HEIGHT + 2][GAME_BOARD_WIDTH + 2];
-extern const struct position positions[TOTAL_BLOCKS][TOTAL_DEGREES];
-
 int snooze(int ms);
 int start_new_game(void);
+int play_replay(const char *path, int fast);
 void display_set_options(void);
-int initialize_game_elements(void);
 input_t fetch_user_input(void);
+input_t fetch_user_input_nowait(void);
+int fetch_user_inputs(input_t *inputs, int max);
 
 int initialize_graphics(void);
+int select_renderer(const char *name);
+const char *renderer_name(void);
+void render_frame(void);
 void deinitialize_graphics(void);
 int display_main_menu(void);
 void initialize_game_screen(void);
@@ -103,14 +74,21 @@ int display_quit_dialog(void);
 int draw_start_game(void);
 void draw_gameover(int reason);
 void draw_next_block(block_t type, degree_t orientation);
-void draw_game_board(struct block *current);
+void draw_game_board(const struct game_state *game);
+void draw_board_rows(const row_t *rows);
 void draw_score_board(struct game_score *score);
 void draw_level_info(int level);
 void draw_game_paused(void);
 void draw_highscore(int score);
-void draw_cleared_rows_animation_1(int *cleared_rows, int count);
-void draw_cleared_rows_animation_2(int *cleared_rows, int count);
-void draw_cleared_rows_animation_3(int *cleared_rows, int count);
+void draw_cleared_rows_animation_1(const int *cleared_rows, int count);
+void draw_cleared_rows_animation_2(const int *cleared_rows, int count);
+void draw_cleared_rows_animation_3(const int *cleared_rows, int count);
+
+void animation_start(struct animation *animation, animation_t type,
+        const int *rows, int count, int level);
+int animation_update(struct animation *animation, int elapsed_ms);
+int animation_duration(animation_t type);
+void animation_run(struct animation *animation);
 
 #endif	/* __TETRIZ_H__ */
 
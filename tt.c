@@ -0,0 +1,178 @@
+#include "tt.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+_Static_assert(sizeof (struct tt_data) == sizeof (uint64_t),
+        "the data of an entry must fit in one word");
+_Static_assert(sizeof (struct tt_bucket) == 64, "a bucket is a cache line");
+
+/* each thread's slot in the counters, handed out as they first count */
+static _Thread_local int counter_slot = -1;
+static atomic_int next_counter_slot;
+
+static struct tt_counter *my_counter(struct transposition_table *table)
+{
+    if (counter_slot < 0)
+        counter_slot = atomic_fetch_add_explicit(&next_counter_slot, 1,
+                memory_order_relaxed) % TT_COUNTER_SLOTS;
+    return &table->counters[counter_slot];
+}
+
+static void count(atomic_uint_least64_t *counter)
+{
+    atomic_fetch_add_explicit(counter, 1, memory_order_relaxed);
+}
+
+static uint64_t pack(const struct tt_data *data)
+{
+    uint64_t word;
+
+    memcpy(&word, data, sizeof (word));
+    return word;
+}
+
+static void unpack(uint64_t word, struct tt_data *data)
+{
+    memcpy(data, &word, sizeof (*data));
+}
+
+static struct tt_bucket *bucket_of(const struct transposition_table *table,
+        uint64_t key)
+{
+    return &table->buckets[key & table->mask];
+}
+
+/* a table of 2^bits buckets, all empty; FAILURE if there's no memory */
+int tt_init(struct transposition_table *table, int bits)
+{
+    size_t buckets = (size_t)1 << bits;
+
+    memset(table, 0, sizeof (*table));
+    table->buckets = aligned_alloc(sizeof (struct tt_bucket),
+            buckets * sizeof (struct tt_bucket));
+    if (!table->buckets)
+        return FAILURE;
+
+    table->mask = buckets - 1;
+    atomic_init(&table->generation, 1);
+    tt_clear(table);
+    return SUCCESS;
+}
+
+void tt_free(struct transposition_table *table)
+{
+    free(table->buckets);
+    table->buckets = NULL;
+}
+
+/* empty out every entry, while no one else is using the table */
+void tt_clear(struct transposition_table *table)
+{
+    memset(table->buckets, 0, (table->mask + 1) * sizeof (struct tt_bucket));
+}
+
+/* the entries stored from now on are newer than all of the ones before */
+void tt_new_search(struct transposition_table *table)
+{
+    unsigned int generation = atomic_load(&table->generation) + 1;
+
+    /* no entry ever has a generation of 0, so none is ever all zeros */
+    if (!(uint8_t)generation)
+        generation++;
+    atomic_store(&table->generation, generation);
+}
+
+/* what's stored for the key, if there's anything; FAILURE if not */
+int tt_probe(struct transposition_table *table, uint64_t key,
+        struct tt_data *data)
+{
+    int i;
+    uint64_t word;
+    struct tt_bucket *bucket = bucket_of(table, key);
+    struct tt_counter *counter = my_counter(table);
+
+    for (i = 0; i < TT_BUCKET_ENTRIES; i++) {
+        struct tt_entry *entry = &bucket->entries[i];
+
+        word = atomic_load_explicit(&entry->data, memory_order_relaxed);
+        if (word && (atomic_load_explicit(&entry->check,
+                        memory_order_relaxed) ^ word) == key) {
+            unpack(word, data);
+            count(&counter->hits);
+            return SUCCESS;
+        }
+    }
+
+    count(&counter->misses);
+    return FAILURE;
+}
+
+void tt_store(struct transposition_table *table, uint64_t key,
+        const struct tt_data *data)
+{
+    int i, victim = 0;
+    int worth, victim_worth = INT32_MAX;
+    uint64_t word;
+    struct tt_data stored, old;
+    struct tt_bucket *bucket = bucket_of(table, key);
+
+    stored = *data;
+    stored.generation = (uint8_t)atomic_load_explicit(&table->generation,
+            memory_order_relaxed);
+
+    for (i = 0; i < TT_BUCKET_ENTRIES; i++) {
+        struct tt_entry *entry = &bucket->entries[i];
+
+        word = atomic_load_explicit(&entry->data, memory_order_relaxed);
+        if (!word) {
+            worth = -1;                 /* nothing beats an empty one */
+        } else {
+            unpack(word, &old);
+
+            /* the same board: only a search at least as deep replaces it */
+            if ((atomic_load_explicit(&entry->check, memory_order_relaxed) ^
+                        word) == key) {
+                if (old.depth > stored.depth &&
+                        old.generation == stored.generation)
+                    return;
+                victim = i;
+                break;
+            }
+
+            /* older searches go first, then the shallowest */
+            worth = old.depth +
+                (old.generation == stored.generation ? 256 : 0);
+        }
+
+        if (worth < victim_worth) {
+            victim = i;
+            victim_worth = worth;
+        }
+    }
+
+    word = pack(&stored);
+    atomic_store_explicit(&bucket->entries[victim].data, word,
+            memory_order_relaxed);
+    atomic_store_explicit(&bucket->entries[victim].check, key ^ word,
+            memory_order_relaxed);
+    count(&my_counter(table)->stores);
+}
+
+/* the counts of every thread added up, as they are right now */
+void tt_counts(struct transposition_table *table, struct tt_counts *counts)
+{
+    int i;
+
+    memset(counts, 0, sizeof (*counts));
+    for (i = 0; i < TT_COUNTER_SLOTS; i++) {
+        counts->hits += atomic_load_explicit(&table->counters[i].hits,
+                memory_order_relaxed);
+        counts->misses += atomic_load_explicit(&table->counters[i].misses,
+                memory_order_relaxed);
+        counts->stores += atomic_load_explicit(&table->counters[i].stores,
+                memory_order_relaxed);
+    }
+}
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
@@ -0,0 +1,78 @@
+#ifndef __TT_H__
+#define __TT_H__
+
+#include "engine.h"
+
+#include <stdatomic.h>
+
+/*
+ * A transposition table, for searches that reach the same board by more
+ * than one road: what was found out about a board, by its hash (see
+ * game_state.hash). It's a fixed number of buckets, each one a cache line
+ * of TT_BUCKET_ENTRIES entries, and any number of threads can share it with
+ * no locks at all.
+ *
+ * An entry is two 64 bit words, the data and the key XORed with the data,
+ * each written and read in one go. An entry that two threads wrote at once
+ * can end up with the words of both, but then the two don't give back a
+ * key that anyone would look for, so it's a miss rather than a wrong hit
+ * (the lockless hashing of Hyatt and Mann).
+ *
+ * When a bucket is full, a new entry pushes out one from an older search
+ * (see tt_new_search()), or else the one searched the least deep; an entry
+ * for the same board is only replaced by one searched at least as deep.
+ */
+
+#define TT_BUCKET_ENTRIES   4
+#define TT_COUNTER_SLOTS    64          /* threads counting on their own */
+
+struct tt_data {
+    float value;
+    uint8_t depth;                      /* how deep the value goes */
+    uint8_t move;                       /* the best placement, say */
+    uint8_t flags;                      /* up to the search */
+    uint8_t generation;                 /* set by tt_store() */
+};
+
+struct tt_entry {
+    atomic_uint_least64_t check;        /* the key ^ data */
+    atomic_uint_least64_t data;         /* a struct tt_data, 0 if empty */
+};
+
+struct tt_bucket {
+    _Alignas(64) struct tt_entry entries[TT_BUCKET_ENTRIES];
+};
+
+/* every thread counts on a cache line of its own, mostly */
+struct tt_counter {
+    _Alignas(64) atomic_uint_least64_t hits;
+    atomic_uint_least64_t misses;
+    atomic_uint_least64_t stores;
+};
+
+struct transposition_table {
+    struct tt_bucket *buckets;
+    uint64_t mask;                      /* buckets - 1 */
+    atomic_uint generation;
+    struct tt_counter counters[TT_COUNTER_SLOTS];
+};
+
+struct tt_counts {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t stores;
+};
+
+int tt_init(struct transposition_table *table, int bits);
+void tt_free(struct transposition_table *table);
+void tt_clear(struct transposition_table *table);
+void tt_new_search(struct transposition_table *table);
+int tt_probe(struct transposition_table *table, uint64_t key,
+        struct tt_data *data);
+void tt_store(struct transposition_table *table, uint64_t key,
+        const struct tt_data *data);
+void tt_counts(struct transposition_table *table, struct tt_counts *counts);
+
+#endif	/* __TT_H__ */
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */
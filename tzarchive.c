@@ -0,0 +1,265 @@
+#include "archive.h"
+#include <pthread.h>
+
+#include <time.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ * tzarchive: builds replay archives out of replay files, and verifies them
+ * by replaying every record with the headless engine. The verification is
+ * spread over a number of threads, each taking its own slice of every block
+ * and keeping its own counters.
+ */
+
+struct verify_thread {
+    pthread_t thread_id;
+    int index;
+    int threads;
+    const struct archive *archive;
+    long records;
+    long events;
+    long mismatches;
+    long corrupt;                       /* of those, blocks or records */
+    uint64_t bytes;
+};
+
+static const char *prog_name = NULL;
+
+
+static void usage(void)
+{
+    fprintf(stderr,
+            "usage: %s append ARCHIVE REPLAY...\n"
+            "       %s verify [-j threads] ARCHIVE\n\n"
+            "'append' adds the replay files (see tetriz --record) to ARCHIVE"
+            " as a new block,\ncreating it if needed. 'verify' replays every"
+            " record of ARCHIVE and checks\nthe final scores.\n",
+            prog_name, prog_name);
+}
+
+static int do_append(int argc, char **argv)
+{
+    int i;
+    int status;
+    struct replay *replays;
+
+    if (argc < 3) {
+        usage();
+        return FAILURE;
+    }
+
+    replays = calloc(argc - 2, sizeof (*replays));
+    if (!replays) {
+        fprintf(stderr, "%s: out of memory\n", prog_name);
+        return FAILURE;
+    }
+
+    for (i = 2; i < argc; i++) {
+        if (replay_load(&replays[i - 2], argv[i])) {
+            fprintf(stderr, "%s: failed to load the replay '%s'\n",
+                    prog_name, argv[i]);
+            status = FAILURE;
+            goto out;
+        }
+    }
+
+    status = archive_append(argv[1], replays, argc - 2);
+    if (status)
+        fprintf(stderr, "%s: failed to append to '%s'\n", prog_name, argv[1]);
+    else
+        printf("appended %d replays to %s\n", argc - 2, argv[1]);
+
+out:
+    for (i = 0; i < argc - 2; i++)
+        replay_free(&replays[i]);
+    free(replays);
+
+    return status;
+}
+
+
+static int verify_record(const struct archive_record *record, long *events)
+{
+    int status;
+    struct game_state game;
+    const struct game_score *score = &record->final_score;
+
+    game_init(&game, &record->options, 0, record->seed);
+    status = replay_run(record->events, record->length, &game, events);
+
+    if (game.score.score != score->score ||
+            game.score.total_rows != score->total_rows ||
+            game.score.level != score->level)
+        status = FAILURE;
+
+    return status;
+}
+
+static void *verify_thread_fn(void *arg)
+{
+    uint32_t b, i, first, last;
+    long events;
+    struct archive_block block;
+    struct archive_record record;
+    struct verify_thread *thread = (struct verify_thread *)arg;
+    const struct archive *archive = thread->archive;
+
+    for (b = 0; b < archive->blocks; b++) {
+        if (archive_block(archive, b, &block)) {
+            /* every thread finds it, only the first one tells */
+            if (thread->index == 0) {
+                printf("block %u: corrupt\n", b);
+                thread->mismatches++;
+                thread->corrupt++;
+            }
+            continue;
+        }
+
+        /* a contiguous slice of the block, so the threads share no pages */
+        first = (uint64_t)block.count * thread->index / thread->threads;
+        last = (uint64_t)block.count * (thread->index + 1) / thread->threads;
+
+        for (i = first; i < last; i++) {
+            if (archive_record(&block, i, &record)) {
+                printf("block %u, record %u: corrupt\n", b, i);
+                thread->mismatches++;
+                thread->corrupt++;
+                continue;
+            }
+
+            events = 0;
+            if (verify_record(&record, &events)) {
+                printf("block %u, record %u (seed %llu): MISMATCH\n", b, i,
+                        (unsigned long long)record.seed);
+                thread->mismatches++;
+            }
+
+            thread->records++;
+            thread->events += events;
+            thread->bytes += record.length;
+        }
+    }
+
+    return arg;
+}
+
+static int do_verify(int argc, char **argv)
+{
+    int i, opt;
+    int threads;
+    long cpus;
+    long records = 0, events = 0, mismatches = 0, corrupt = 0;
+    uint64_t bytes = 0;
+    double seconds;
+    struct archive archive;
+    struct timespec start, end;
+    struct verify_thread *data;
+
+    cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? (int)cpus : 1;
+
+    while ((opt = getopt(argc, argv, "j:")) != -1) {
+        switch (opt) {
+            case 'j':
+                threads = atoi(optarg);
+                break;
+            default:
+                usage();
+                return FAILURE;
+        }
+    }
+
+    if (optind != argc - 1 || threads <= 0) {
+        usage();
+        return FAILURE;
+    }
+
+    if (archive_open(&archive, argv[optind])) {
+        fprintf(stderr, "%s: failed to open the archive '%s'\n", prog_name,
+                argv[optind]);
+        return FAILURE;
+    }
+
+    data = calloc(threads, sizeof (*data));
+    if (!data) {
+        fprintf(stderr, "%s: out of memory\n", prog_name);
+        archive_close(&archive);
+        return FAILURE;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    for (i = 0; i < threads; i++) {
+        data[i].index = i;
+        data[i].threads = threads;
+        data[i].archive = &archive;
+
+        if (pthread_create(&data[i].thread_id, NULL, verify_thread_fn,
+                    (void *)&data[i])) {
+            fprintf(stderr, "%s: failed to create thread %d\n", prog_name, i);
+            while (i--)
+                pthread_join(data[i].thread_id, NULL);
+            free(data);
+            archive_close(&archive);
+            return FAILURE;
+        }
+    }
+
+    for (i = 0; i < threads; i++) {
+        pthread_join(data[i].thread_id, NULL);
+        records += data[i].records;
+        events += data[i].events;
+        mismatches += data[i].mismatches;
+        corrupt += data[i].corrupt;
+        bytes += data[i].bytes;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    if (seconds <= 0)
+        seconds = 1e-9;
+
+    /*
+     * Records the header counts but the blocks don't hold are a failure, one
+     * already counted if they're missing because of what was found corrupt.
+     */
+    if ((uint64_t)records != archive.records && !corrupt)
+        mismatches++;
+
+    printf("blocks       : %u\n", archive.blocks);
+    printf("records      : %ld of %llu%s\n", records,
+            (unsigned long long)archive.records,
+            (uint64_t)records != archive.records ? " (MISMATCH)" : "");
+    printf("mismatches   : %ld\n", mismatches);
+    printf("threads      : %d\n", threads);
+    printf("elapsed      : %.3f s\n", seconds);
+    printf("records/sec  : %.1f\n", records / seconds);
+    printf("events/sec   : %.1f\n", events / seconds);
+    printf("MB/sec       : %.1f\n", bytes / seconds / (1 << 20));
+
+    free(data);
+    archive_close(&archive);
+
+    return mismatches ? FAILURE : SUCCESS;
+}
+
+
+int main(int argc, char **argv)
+{
+    prog_name = strrchr(*argv, '/');
+    prog_name = prog_name ? (prog_name + 1) : *argv;
+
+    if (argc >= 2 && strcmp(argv[1], "append") == 0)
+        return do_append(argc - 1, argv + 1);
+
+    if (argc >= 2 && strcmp(argv[1], "verify") == 0)
+        return do_verify(argc - 1, argv + 1);
+
+    usage();
+    return FAILURE;
+}
+
+/* vim: set ai ts=4 sw=4 tw=80 expandtab: */